@@ -0,0 +1,460 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "Materials.h"
+
+//DEFAULT_MATERIALS, materials.txt as a string (generated by CMake)
+#include "MaterialsDefault.h"
+
+static const char *const FLAG_NAMES[] = { "static", "floats", "spreads", "burns", "ember" };
+static const unsigned char FLAG_VALUES[] = { MATERIAL_STATIC, MATERIAL_FLOATS, MATERIAL_SPREADS, MATERIAL_BURNS, MATERIAL_EMBER };
+static const int FLAG_COUNT = 5;
+
+static const char *const DIR_NAMES[] = { "up", "down", "left", "right", "first", "second" };
+static const int DIR_COUNT = 6;
+
+Materials::Materials()
+{
+    memset(mFlags, 0, sizeof(mFlags));
+    memset(mDensity, 0, sizeof(mDensity));
+    memset(mColored, 0, sizeof(mColored));
+    memset(mColor, 0, sizeof(mColor));
+    memset(mSwap, 0, sizeof(mSwap));
+    for(int i = 0; i <= MAX_MATERIALS; i++)
+        mFirst[i] = 0;
+
+    mFlags[MATERIAL_BORDER] = MATERIAL_STATIC;
+}
+
+const Materials &Materials::Default()
+{
+    static Materials materials;
+    static bool loaded = false;
+
+    if(!loaded)
+    {
+        std::string error;
+        if(!materials.Parse(DEFAULT_MATERIALS, "materials.txt", error))
+        {
+            fprintf(stderr, "Built-in %s\n", error.c_str());
+            abort();
+        }
+        loaded = true;
+    }
+    return materials;
+}
+
+int Materials::Find(const std::string &name) const
+{
+    std::map<std::string, int>::const_iterator it = mIds.find(name);
+    return it == mIds.end() ? -1 : it->second;
+}
+
+uint64_t Materials::GetHash() const
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto Mix = [&hash](const void *data, size_t size)
+    {
+        const unsigned char *bytes = (const unsigned char *)data;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash ^= (uint64_t)bytes[i];
+            hash *= 0x100000001B3ull;
+        }
+    };
+
+    for(int t = 0; t < MAX_MATERIALS; t++)
+    {
+        Mix(mNames[t].c_str(), mNames[t].size() + 1);
+        Mix(&mFlags[t], sizeof(mFlags[t]));
+        Mix(&mDensity[t], sizeof(mDensity[t]));
+        Mix(mSwap[t], sizeof(mSwap[t]));
+        Mix(&mFirst[t+1], sizeof(mFirst[t+1]));
+    }
+
+    //Field by field, the padding of a Reaction is not ours to hash
+    for(const Reaction &rule : mReactions)
+    {
+        Mix(&rule.pick, sizeof(rule.pick));
+        Mix(&rule.dirCount, sizeof(rule.dirCount));
+        Mix(rule.dirs, rule.dirCount);
+        Mix(&rule.chance, sizeof(rule.chance));
+        Mix(&rule.then, sizeof(rule.then));
+        Mix(&rule.stop, sizeof(rule.stop));
+        Mix(rule.match, sizeof(rule.match));
+        Mix(rule.self, sizeof(rule.self));
+        Mix(rule.other, sizeof(rule.other));
+        Mix(rule.beyond, sizeof(rule.beyond));
+    }
+    return hash;
+}
+
+bool Materials::Load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path.c_str());
+    if(!file)
+    {
+        error = "Can't open " + path;
+        return false;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+    return Parse(text.str(), path, error);
+}
+
+//Parses "NAME", "NAME:rest" or "NAME:moved" into a material id and the
+//matching states
+static bool ParseState(const Materials &table, const std::string &token, int &id, unsigned char &states)
+{
+    std::string name = token;
+    states = MATCH_RESTING | MATCH_MOVED;
+
+    size_t colon = token.find(':');
+    if(colon != std::string::npos)
+    {
+        name = token.substr(0, colon);
+        std::string state = token.substr(colon + 1);
+        if(state == "rest")
+            states = MATCH_RESTING;
+        else if(state == "moved")
+            states = MATCH_MOVED;
+        else
+            return false;
+    }
+
+    id = table.Find(name);
+    return id >= 0;
+}
+
+static int ParseFlag(const std::string &name)
+{
+    for(int i = 0; i < FLAG_COUNT; i++)
+    {
+        if(name == FLAG_NAMES[i])
+            return FLAG_VALUES[i];
+    }
+    return 0;
+}
+
+static bool ParseCount(std::istringstream &in, int &n, int max)
+{
+    return (in >> n) && n >= 1 && n <= max;
+}
+
+//Adds (or with !, removes) the types a match token stands for
+static bool ParseMatch(const Materials &table, std::string token, unsigned char *mask)
+{
+    bool remove = false;
+    if(!token.empty() && token[0] == '!')
+    {
+        remove = true;
+        token = token.substr(1);
+    }
+
+    unsigned char add[MAX_MATERIALS];
+    memset(add, 0, sizeof(add));
+
+    if(token == "*" || (!token.empty() && token[0] == '@'))
+    {
+        int flag = token == "*" ? 0 : ParseFlag(token.substr(1));
+        if(token != "*" && !flag)
+            return false;
+        for(int t = 0; t < MAX_MATERIALS; t++)
+        {
+            if(table.IsDefined(t) && (!flag || table.Has(t, flag)))
+                add[t] = MATCH_RESTING | MATCH_MOVED;
+        }
+    }
+    else
+    {
+        int id;
+        unsigned char states;
+        if(!ParseState(table, token, id, states))
+            return false;
+        add[id] = states;
+    }
+
+    for(int t = 0; t < MAX_MATERIALS; t++)
+        mask[t] = remove ? mask[t] & ~add[t] : mask[t] | add[t];
+    return true;
+}
+
+static bool ParseOutcome(const Materials &table, const std::string &token, unsigned char &outcome)
+{
+    if(token == ".")
+    {
+        outcome = OUTCOME_KEEP;
+        return true;
+    }
+    if(token == "other")
+    {
+        outcome = OUTCOME_OTHER;
+        return true;
+    }
+
+    int id;
+    unsigned char states;
+    if(!ParseState(table, token, id, states) || states == MATCH_RESTING)
+        return false;
+    outcome = states == MATCH_MOVED ? (unsigned char)(id | OUTCOME_MOVED) : (unsigned char)id;
+    return true;
+}
+
+bool Materials::Parse(const std::string &text, const std::string &source, std::string &error)
+{
+    Materials table;
+    int line = 0;
+
+    auto Fail = [&](const std::string &message)
+    {
+        std::ostringstream out;
+        out << source << ":" << line << ": " << message;
+        error = out.str();
+        return false;
+    };
+
+    //The material each rule belongs to, to sort them afterwards
+    std::vector<int> owners;
+    //Whether the last rule got any case yet
+    bool ruleHasCase = true;
+
+    std::istringstream lines(text);
+    std::string row;
+    while(std::getline(lines, row))
+    {
+        line++;
+
+        size_t comment = row.find('#');
+        if(comment != std::string::npos)
+            row.erase(comment);
+
+        std::istringstream in(row);
+        std::string keyword;
+        if(!(in >> keyword))
+            continue;
+
+        if(keyword == "material")
+        {
+            std::string name, flag;
+            int id, density;
+            if(!(in >> name >> id >> density))
+                return Fail("Expected: material <NAME> <id> <density> [color <r> <g> <b>] [flags]");
+            if(id < 0 || id >= MATERIAL_BORDER)
+                return Fail("Material ids go from 0 to 62");
+            if(table.IsDefined(id) || table.Find(name) >= 0)
+                return Fail("Material " + name + " is defined twice");
+
+            table.mNames[id] = name;
+            table.mIds[name] = id;
+            table.mDensity[id] = density;
+            while(in >> flag)
+            {
+                if(flag == "color")
+                {
+                    int r, g, b;
+                    if(!(in >> r >> g >> b) || std::min(r, std::min(g, b)) < 0 || std::max(r, std::max(g, b)) > 255)
+                        return Fail("Expected: color <r> <g> <b>, from 0 to 255");
+                    table.mColored[id] = true;
+                    table.mColor[id][0] = (unsigned char)r;
+                    table.mColor[id][1] = (unsigned char)g;
+                    table.mColor[id][2] = (unsigned char)b;
+                    continue;
+                }
+
+                int value = ParseFlag(flag);
+                if(!value)
+                    return Fail("Unknown flag " + flag);
+                table.mFlags[id] |= value;
+            }
+        }
+        else if(keyword == "swap")
+        {
+            std::string lighter, heavier, word;
+            int chance = 1;
+            if(!(in >> lighter >> heavier))
+                return Fail("Expected: swap <LIGHTER> <HEAVIER> [chance <n>]");
+            if((in >> word) && (word != "chance" || !ParseCount(in, chance, 255)))
+                return Fail("Expected: swap <LIGHTER> <HEAVIER> [chance <n>]");
+
+            int a = table.Find(lighter), b = table.Find(heavier);
+            if(a < 0 || b < 0)
+                return Fail("Unknown material in swap");
+            if(table.mDensity[b] <= table.mDensity[a])
+                return Fail(heavier + " is not heavier than " + lighter);
+            table.mSwap[a][b] = (unsigned char)chance;
+        }
+        else if(keyword == "rule")
+        {
+            if(!ruleHasCase)
+                return Fail("The rule before this one has no case");
+
+            std::string name, word;
+            in >> name;
+            int owner = table.Find(name);
+            if(owner < 0)
+                return Fail("Unknown material " + name);
+
+            Reaction rule;
+            memset(&rule, 0, sizeof(rule));
+            rule.chance = 1;
+            rule.then = 1;
+            memset(rule.self, OUTCOME_KEEP, sizeof(rule.self));
+            memset(rule.other, OUTCOME_KEEP, sizeof(rule.other));
+            memset(rule.beyond, OUTCOME_KEEP, sizeof(rule.beyond));
+            bool picked = false;
+
+            while(in >> word)
+            {
+                if(word == "chance")
+                {
+                    if(!ParseCount(in, rule.chance, 1000000))
+                        return Fail("chance needs a number");
+                }
+                else if(word == "then")
+                {
+                    if(!ParseCount(in, rule.then, 1000000))
+                        return Fail("then needs a number");
+                }
+                else if(word == "stop")
+                    rule.stop = true;
+                else if(word == "self")
+                {
+                    rule.pick = PICK_SELF;
+                    picked = true;
+                }
+                else if(word == "each" || word == "any" || word == "one")
+                {
+                    rule.pick = word == "each" ? PICK_EACH : word == "any" ? PICK_ANY : PICK_ONE;
+                    picked = true;
+
+                    std::string dirs;
+                    in >> dirs;
+                    std::istringstream list(dirs);
+                    std::string dir;
+                    while(std::getline(list, dir, ','))
+                    {
+                        int d = 0;
+                        while(d < DIR_COUNT && dir != DIR_NAMES[d])
+                            d++;
+                        if(d == DIR_COUNT)
+                            return Fail("Unknown direction " + dir);
+                        if((d == DIR_FIRST || d == DIR_SECOND) && table.Has(owner, MATERIAL_STATIC))
+                            return Fail("Static materials have no first and second");
+                        if(rule.dirCount == 4)
+                            return Fail("At most 4 directions");
+                        rule.dirs[rule.dirCount++] = (unsigned char)d;
+                    }
+                    if(rule.dirCount == 0)
+                        return Fail("No directions given");
+                }
+                else
+                    return Fail("Unexpected " + word);
+            }
+            if(!picked)
+                return Fail("Expected each, any, one or self");
+
+            table.mReactions.push_back(rule);
+            owners.push_back(owner);
+            ruleHasCase = false;
+        }
+        else if(keyword == "case")
+        {
+            if(table.mReactions.empty())
+                return Fail("case without a rule");
+            Reaction &rule = table.mReactions.back();
+
+            unsigned char mask[MAX_MATERIALS];
+            memset(mask, 0, sizeof(mask));
+
+            std::string word;
+            while((in >> word) && word != "->")
+            {
+                if(!ParseMatch(table, word, mask))
+                    return Fail("Unknown match " + word);
+            }
+            if(word != "->")
+                return Fail("Expected -> after the match");
+
+            unsigned char outcomes[3] = { OUTCOME_KEEP, OUTCOME_KEEP, OUTCOME_KEEP };
+            int count = 0;
+            while(in >> word)
+            {
+                if(count == 3 || !ParseOutcome(table, word, outcomes[count]))
+                    return Fail("Bad outcome " + word);
+                count++;
+            }
+            if(count == 0)
+                return Fail("Expected an outcome after ->");
+            if(rule.pick == PICK_SELF && (count > 1 || outcomes[0] == OUTCOME_OTHER))
+                return Fail("A self rule only changes the particle itself");
+
+            //The simulation wakes the cells around a particle assuming it
+            //writes at most two cells up, and one in any other direction
+            if(outcomes[2] != OUTCOME_KEEP && (rule.dirCount != 1 || rule.dirs[0] != DIR_UP))
+                return Fail("Only rules looking up can change the cell past the neighbour");
+
+            //Every type goes to the first case that matches it. Nothing
+            //matches the border.
+            for(int t = 0; t < MATERIAL_BORDER; t++)
+            {
+                if(!mask[t] || rule.match[t])
+                    continue;
+                rule.match[t] = mask[t];
+                rule.self[t] = outcomes[0];
+                rule.other[t] = outcomes[1];
+                rule.beyond[t] = outcomes[2];
+            }
+            ruleHasCase = true;
+        }
+        else
+            return Fail("Unknown keyword " + keyword);
+    }
+
+    if(!ruleHasCase)
+        return Fail("The last rule has no case");
+    if(!table.IsDefined(0))
+        return Fail("Material 0 (the empty cell) is missing");
+
+    //Group the rules by material, keeping their order
+    std::vector<Reaction> sorted;
+    for(int t = 0; t < MAX_MATERIALS; t++)
+    {
+        table.mFirst[t] = (int)sorted.size();
+        for(size_t i = 0; i < owners.size(); i++)
+        {
+            if(owners[i] == t)
+                sorted.push_back(table.mReactions[i]);
+        }
+    }
+    table.mFirst[MAX_MATERIALS] = (int)sorted.size();
+    table.mReactions.swap(sorted);
+
+    *this = table;
+    return true;
+}
@@ -0,0 +1,161 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SDLSAND_MATERIALS_H
+#define SDLSAND_MATERIALS_H
+
+// The material table: what each particle type is and how it reacts with its
+// neighbours. It is read from a text file (see materials.txt for the format)
+// and compiled into dense tables indexed by cell value, so the simulation
+// only does lookups instead of comparing types one by one.
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+//Material ids are cell values and index the tables below
+const int MAX_MATERIALS = 64;
+
+//The last id is reserved for the ring of cells around the grid. It is
+//static, has no name, and no case or swap ever matches it.
+const int MATERIAL_BORDER = MAX_MATERIALS - 1;
+
+//Material flags
+const unsigned char MATERIAL_STATIC = 1;   //never moves (walls, spouts, plants)
+const unsigned char MATERIAL_FLOATS = 2;   //rises instead of falling
+const unsigned char MATERIAL_SPREADS = 4;  //slides sideways when it can't fall or rise
+const unsigned char MATERIAL_BURNS = 8;    //burnable - like PLANT and OIL
+const unsigned char MATERIAL_EMBER = 16;   //burns as ember rather than fire
+
+//Neighbours a reaction looks at. FIRST and SECOND are the two sides in the
+//random order a moving particle picked for this step.
+enum Direction
+{
+    DIR_UP,
+    DIR_DOWN,
+    DIR_LEFT,
+    DIR_RIGHT,
+    DIR_FIRST,
+    DIR_SECOND
+};
+
+//How a reaction picks among its directions
+enum Pick
+{
+    PICK_EACH,  //every matching neighbour in turn
+    PICK_ANY,   //the first matching neighbour only
+    PICK_ONE,   //one of the directions at random
+    PICK_SELF   //no neighbour, the particle itself
+};
+
+//States of a neighbour a reaction matches
+const unsigned char MATCH_RESTING = 1;
+const unsigned char MATCH_MOVED = 2;
+
+//What a reaction leaves in a cell: a material id, OR'ed with OUTCOME_MOVED
+//to place it as already moved this step, or one of the special values
+const unsigned char OUTCOME_MOVED = 0x80;
+const unsigned char OUTCOME_KEEP = 0x7F;   //leave the cell alone
+const unsigned char OUTCOME_OTHER = 0x7E;  //what the other cell held (swaps)
+
+struct Reaction
+{
+    unsigned char pick;
+    unsigned char dirCount;
+    unsigned char dirs[4];
+
+    //1 in chance odds rolled before looking around, 1 in then odds rolled
+    //for every matching neighbour (1 = always, no roll)
+    int chance;
+    int then;
+
+    //The particle is done for this step once the reaction happened
+    bool stop;
+
+    //Indexed by the neighbour's type: the states that match, and what
+    //the particle, the neighbour and the cell past the neighbour become
+    unsigned char match[MAX_MATERIALS];
+    unsigned char self[MAX_MATERIALS];
+    unsigned char other[MAX_MATERIALS];
+    unsigned char beyond[MAX_MATERIALS];
+};
+
+class Materials
+{
+public:
+    //An empty table, every id is an undefined material
+    Materials();
+
+    //The table from materials.txt the game was built with
+    static const Materials &Default();
+
+    //Replacing the table with the one in text / in a file. On error the
+    //table is left as it was and error says what went wrong.
+    bool Parse(const std::string &text, const std::string &source, std::string &error);
+    bool Load(const std::string &path, std::string &error);
+
+    bool IsDefined(int type) const { return !mNames[type].empty(); }
+    bool Has(int type, unsigned char flag) const { return (mFlags[type] & flag) != 0; }
+    int GetDensity(int type) const { return mDensity[type]; }
+    const std::string &GetName(int type) const { return mNames[type]; }
+
+    //The color a type is drawn in, as red, green and blue. Types without
+    //one are left to the game to show as it likes.
+    bool HasColor(int type) const { return mColored[type]; }
+    const unsigned char *GetColor(int type) const { return mColor[type]; }
+
+    //Id of a named material, -1 if there is none
+    int Find(const std::string &name) const;
+
+    //64 bit FNV-1a hash of everything that affects the simulation (not the
+    //colors), to tell whether two tables behave the same
+    uint64_t GetHash() const;
+
+    //1 in n odds of type trading places with the resting type above it,
+    //0 if it never does
+    int GetSwapChance(int type, int above) const { return mSwap[type][above]; }
+
+    //The reactions of a type, in the order they are tried
+    const Reaction *FirstReaction(int type) const { return mReactions.data() + mFirst[type]; }
+    const Reaction *EndReaction(int type) const { return mReactions.data() + mFirst[type+1]; }
+
+    //Reactions of all types are numbered 0..GetReactionCount()-1, in the
+    //order of FirstReaction(0) on
+    int GetReactionCount() const { return (int)mReactions.size(); }
+    int GetReactionIndex(const Reaction *rule) const { return (int)(rule - mReactions.data()); }
+
+private:
+    std::string mNames[MAX_MATERIALS];
+    std::map<std::string, int> mIds;
+    unsigned char mFlags[MAX_MATERIALS];
+    int mDensity[MAX_MATERIALS];
+    bool mColored[MAX_MATERIALS];
+    unsigned char mColor[MAX_MATERIALS][3];
+    unsigned char mSwap[MAX_MATERIALS][MAX_MATERIALS];
+
+    //Reactions sorted by material, those of type t are mFirst[t]..mFirst[t+1]-1
+    std::vector<Reaction> mReactions;
+    int mFirst[MAX_MATERIALS+1];
+};
+
+#endif //SDLSAND_MATERIALS_H
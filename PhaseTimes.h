@@ -0,0 +1,102 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_PHASETIMES_H
+#define SDLSAND_PHASETIMES_H
+
+// Where the time of a frame goes. Time spent in each phase is added up over
+// a frame, and the last WINDOW frames are kept to report the average and the
+// worst case of every phase.
+
+#include <vector>
+
+class PhaseTimes
+{
+public:
+    //Frames the averages and worst cases are taken over
+    static const int WINDOW = 60;
+
+    explicit PhaseTimes(int phases)
+    {
+        mPhases = phases;
+        mCurrent.assign(phases, 0.0);
+        mSamples.assign((size_t)phases * WINDOW, 0.0);
+        mFrames = 0;
+    }
+
+    //Adds seconds spent in phase to the current frame
+    void Add(int phase, double seconds) { mCurrent[phase] += seconds; }
+
+    //Finishes the current frame and starts the next one
+    void EndFrame()
+    {
+        double *sample = &mSamples[(size_t)mPhases * (mFrames % WINDOW)];
+        for(int i = 0; i < mPhases; i++)
+        {
+            sample[i] = mCurrent[i];
+            mCurrent[i] = 0;
+        }
+        mFrames++;
+    }
+
+    //Seconds phase took in the last finished frame
+    double GetLast(int phase) const
+    {
+        return mFrames > 0 ? mSamples[(size_t)mPhases * ((mFrames - 1) % WINDOW) + phase] : 0;
+    }
+
+    //Average and worst seconds of phase over the last WINDOW frames
+    double GetAverage(int phase) const
+    {
+        int frames = GetWindowFrames();
+        double sum = 0;
+        for(int f = 0; f < frames; f++)
+            sum += mSamples[(size_t)mPhases * f + phase];
+        return frames > 0 ? sum / frames : 0;
+    }
+
+    double GetWorst(int phase) const
+    {
+        int frames = GetWindowFrames();
+        double worst = 0;
+        for(int f = 0; f < frames; f++)
+            if(mSamples[(size_t)mPhases * f + phase] > worst)
+                worst = mSamples[(size_t)mPhases * f + phase];
+        return worst;
+    }
+
+    int GetPhases() const { return mPhases; }
+
+    //Frames finished so far
+    long long GetFrames() const { return mFrames; }
+
+private:
+    int GetWindowFrames() const { return mFrames < WINDOW ? (int)mFrames : WINDOW; }
+
+    int mPhases;
+    std::vector<double> mCurrent;
+    std::vector<double> mSamples;
+    long long mFrames;
+};
+
+#endif //SDLSAND_PHASETIMES_H
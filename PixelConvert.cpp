@@ -0,0 +1,273 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "PixelConvert.h"
+
+//The SSSE3 and AVX2 kernels are compiled for their instruction sets one
+//function at a time, so the rest of the program still runs on any x86 CPU.
+//Other CPUs get the scalar loop.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SAND_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static void ConvertScalar(const Cell *cells, int cellStride, int width, int height,
+                          const uint32_t *palette, uint32_t *pixels, int pitch)
+{
+    for(int y = 0; y < height; y++)
+    {
+        const Cell *src = cells + (size_t)cellStride*y;
+        uint32_t *dst = (uint32_t *)((uint8_t *)pixels + (size_t)pitch*y);
+        for(int x = 0; x < width; x++)
+            dst[x] = palette[src[x]];
+    }
+}
+
+#ifdef SAND_X86_KERNELS
+#ifndef SAND_WIDE_CELLS
+
+//pshufb looks bytes up in a table of 16, so the palette of 64 colors is split
+//into byte planes (byte 0 of every color, byte 1, ...) of four tables each:
+//planes[p][k] is byte p of palette[16*k] .. palette[16*k+15]
+__attribute__((target("ssse3")))
+static void SplitPalette(const uint32_t *palette, __m128i planes[4][4])
+{
+    //The bytes of four colors, grouped by plane
+    const __m128i byPlane = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+    for(int k = 0; k < 4; k++)
+    {
+        __m128i c0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(palette + 16*k)), byPlane);
+        __m128i c1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(palette + 16*k + 4)), byPlane);
+        __m128i c2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(palette + 16*k + 8)), byPlane);
+        __m128i c3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(palette + 16*k + 12)), byPlane);
+
+        __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+        __m128i t1 = _mm_unpackhi_epi32(c0, c1);
+        __m128i t2 = _mm_unpacklo_epi32(c2, c3);
+        __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+
+        planes[0][k] = _mm_unpacklo_epi64(t0, t2);
+        planes[1][k] = _mm_unpackhi_epi64(t0, t2);
+        planes[2][k] = _mm_unpacklo_epi64(t1, t3);
+        planes[3][k] = _mm_unpackhi_epi64(t1, t3);
+    }
+}
+
+//16 cells per iteration: every byte plane of the 16 pixels is looked up in
+//its four tables and the planes are interleaved back into pixels.
+//
+//For table k the cell is moved down by 16*k and pushed up by 0x70 with
+//unsigned saturation: cells of the table end up at 0x70..0x7F, everything
+//else has bit 7 set, which makes pshufb return 0 for it.
+__attribute__((target("ssse3")))
+static inline void ConvertBlockSSSE3(const Cell *src, uint32_t *dst, const __m128i planes[4][4])
+{
+    const __m128i bias = _mm_set1_epi8(0x70);
+    const __m128i step = _mm_set1_epi8(16);
+
+    __m128i c = _mm_loadu_si128((const __m128i *)src);
+    __m128i i0 = _mm_adds_epu8(c, bias);
+    c = _mm_sub_epi8(c, step);
+    __m128i i1 = _mm_adds_epu8(c, bias);
+    c = _mm_sub_epi8(c, step);
+    __m128i i2 = _mm_adds_epu8(c, bias);
+    c = _mm_sub_epi8(c, step);
+    __m128i i3 = _mm_adds_epu8(c, bias);
+
+    __m128i p[4];
+    for(int n = 0; n < 4; n++)
+    {
+        p[n] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(planes[n][0], i0), _mm_shuffle_epi8(planes[n][1], i1)),
+                            _mm_or_si128(_mm_shuffle_epi8(planes[n][2], i2), _mm_shuffle_epi8(planes[n][3], i3)));
+    }
+
+    __m128i lo01 = _mm_unpacklo_epi8(p[0], p[1]);
+    __m128i hi01 = _mm_unpackhi_epi8(p[0], p[1]);
+    __m128i lo23 = _mm_unpacklo_epi8(p[2], p[3]);
+    __m128i hi23 = _mm_unpackhi_epi8(p[2], p[3]);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(lo01, lo23));
+    _mm_storeu_si128((__m128i *)(dst + 4), _mm_unpackhi_epi16(lo01, lo23));
+    _mm_storeu_si128((__m128i *)(dst + 8), _mm_unpacklo_epi16(hi01, hi23));
+    _mm_storeu_si128((__m128i *)(dst + 12), _mm_unpackhi_epi16(hi01, hi23));
+}
+
+__attribute__((target("ssse3")))
+static void ConvertSSSE3(const Cell *cells, int cellStride, int width, int height,
+                         const uint32_t *palette, uint32_t *pixels, int pitch)
+{
+    if(width < 16)
+    {
+        ConvertScalar(cells, cellStride, width, height, palette, pixels, pitch);
+        return;
+    }
+
+    __m128i planes[4][4];
+    SplitPalette(palette, planes);
+
+    for(int y = 0; y < height; y++)
+    {
+        const Cell *src = cells + (size_t)cellStride*y;
+        uint32_t *dst = (uint32_t *)((uint8_t *)pixels + (size_t)pitch*y);
+        int x = 0;
+        for(; x + 16 <= width; x += 16)
+            ConvertBlockSSSE3(src + x, dst + x, planes);
+
+        //The last block overlaps the one before it rather than falling
+        //back to single pixels
+        if(x < width)
+            ConvertBlockSSSE3(src + width - 16, dst + width - 16, planes);
+    }
+}
+
+//The same lookup as ConvertBlockSSSE3, 32 cells at a time. pshufb and the
+//unpacks work on the two 128 bit halves separately, so the tables are in
+//both halves and the pixels come out of the unpacks in the order 0-3|16-19,
+//4-7|20-23, ... until the halves are swapped back into place.
+__attribute__((target("avx2")))
+static inline void ConvertBlockAVX2(const Cell *src, uint32_t *dst, const __m256i planes[4][4])
+{
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(16);
+
+    __m256i c = _mm256_loadu_si256((const __m256i *)src);
+    __m256i i0 = _mm256_adds_epu8(c, bias);
+    c = _mm256_sub_epi8(c, step);
+    __m256i i1 = _mm256_adds_epu8(c, bias);
+    c = _mm256_sub_epi8(c, step);
+    __m256i i2 = _mm256_adds_epu8(c, bias);
+    c = _mm256_sub_epi8(c, step);
+    __m256i i3 = _mm256_adds_epu8(c, bias);
+
+    __m256i p[4];
+    for(int n = 0; n < 4; n++)
+    {
+        p[n] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(planes[n][0], i0), _mm256_shuffle_epi8(planes[n][1], i1)),
+                               _mm256_or_si256(_mm256_shuffle_epi8(planes[n][2], i2), _mm256_shuffle_epi8(planes[n][3], i3)));
+    }
+
+    __m256i lo01 = _mm256_unpacklo_epi8(p[0], p[1]);
+    __m256i hi01 = _mm256_unpackhi_epi8(p[0], p[1]);
+    __m256i lo23 = _mm256_unpacklo_epi8(p[2], p[3]);
+    __m256i hi23 = _mm256_unpackhi_epi8(p[2], p[3]);
+
+    __m256i a = _mm256_unpacklo_epi16(lo01, lo23);
+    __m256i b = _mm256_unpackhi_epi16(lo01, lo23);
+    __m256i d = _mm256_unpacklo_epi16(hi01, hi23);
+    __m256i e = _mm256_unpackhi_epi16(hi01, hi23);
+
+    _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 8), _mm256_permute2x128_si256(d, e, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 16), _mm256_permute2x128_si256(a, b, 0x31));
+    _mm256_storeu_si256((__m256i *)(dst + 24), _mm256_permute2x128_si256(d, e, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void ConvertAVX2(const Cell *cells, int cellStride, int width, int height,
+                        const uint32_t *palette, uint32_t *pixels, int pitch)
+{
+    if(width < 32)
+    {
+        ConvertSSSE3(cells, cellStride, width, height, palette, pixels, pitch);
+        return;
+    }
+
+    __m128i split[4][4];
+    SplitPalette(palette, split);
+    __m256i planes[4][4];
+    for(int n = 0; n < 4; n++)
+        for(int k = 0; k < 4; k++)
+            planes[n][k] = _mm256_broadcastsi128_si256(split[n][k]);
+
+    for(int y = 0; y < height; y++)
+    {
+        const Cell *src = cells + (size_t)cellStride*y;
+        uint32_t *dst = (uint32_t *)((uint8_t *)pixels + (size_t)pitch*y);
+        int x = 0;
+        for(; x + 32 <= width; x += 32)
+            ConvertBlockAVX2(src + x, dst + x, planes);
+
+        if(x < width)
+            ConvertBlockAVX2(src + width - 32, dst + width - 32, planes);
+    }
+}
+
+#endif //SAND_WIDE_CELLS
+
+//Eight pixels per gather, 32 per iteration. Fewer instructions than the
+//pshufb kernel, but how fast a gather is differs a lot between CPUs (and
+//microcode updates), so byte cells default to pshufb.
+__attribute__((target("avx2")))
+static void ConvertGatherAVX2(const Cell *cells, int cellStride, int width, int height,
+                              const uint32_t *palette, uint32_t *pixels, int pitch)
+{
+    for(int y = 0; y < height; y++)
+    {
+        const Cell *src = cells + (size_t)cellStride*y;
+        uint32_t *dst = (uint32_t *)((uint8_t *)pixels + (size_t)pitch*y);
+        int x = 0;
+        for(; x + 32 <= width; x += 32)
+        {
+            for(int n = 0; n < 32; n += 8)
+            {
+#ifdef SAND_WIDE_CELLS
+                __m256i index = _mm256_loadu_si256((const __m256i *)(src + x + n));
+#else
+                __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x + n)));
+#endif
+                _mm256_storeu_si256((__m256i *)(dst + x + n), _mm256_i32gather_epi32((const int *)palette, index, 4));
+            }
+        }
+        for(; x < width; x++)
+            dst[x] = palette[src[x]];
+    }
+}
+
+#endif //SAND_X86_KERNELS
+
+std::vector<CellConverterKind> GetCellConverters()
+{
+    std::vector<CellConverterKind> kinds;
+    kinds.push_back({ "scalar", ConvertScalar });
+
+#ifdef SAND_X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        kinds.push_back({ "avx2-gather", ConvertGatherAVX2 });
+#ifndef SAND_WIDE_CELLS
+    if(__builtin_cpu_supports("ssse3"))
+        kinds.push_back({ "ssse3", ConvertSSSE3 });
+    if(__builtin_cpu_supports("avx2"))
+        kinds.push_back({ "avx2", ConvertAVX2 });
+#endif
+#endif
+
+    return kinds;
+}
+
+CellConverter GetCellConverter()
+{
+    static const CellConverter best = GetCellConverters().back().convert;
+    return best;
+}
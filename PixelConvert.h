@@ -0,0 +1,54 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_PIXELCONVERT_H
+#define SDLSAND_PIXELCONVERT_H
+
+// Turning cells into 32 bit pixels through a palette, the last step of
+// drawing the scene. Kept apart from the game so the kernels can be
+// benchmarked without SDL.
+
+#include <cstdint>
+#include <vector>
+#include "World.h"
+
+//Writes palette[cell] for the width x height cells starting at cells, rows
+//cellStride cells apart, to pixels, rows pitch bytes apart. The palette has
+//MAX_MATERIALS entries and every cell must be below MAX_MATERIALS.
+typedef void (*CellConverter)(const Cell *cells, int cellStride, int width, int height,
+                              const uint32_t *palette, uint32_t *pixels, int pitch);
+
+struct CellConverterKind
+{
+    const char *name;
+    CellConverter convert;
+};
+
+//Every converter this CPU can run, the scalar one first and the one to use
+//by default last
+std::vector<CellConverterKind> GetCellConverters();
+
+//The default converter for this CPU, picked on the first call
+CellConverter GetCellConverter();
+
+#endif //SDLSAND_PIXELCONVERT_H
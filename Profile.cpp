@@ -0,0 +1,125 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "Profile.h"
+
+Profile::Profile()
+{
+    Clear(0);
+}
+
+void Profile::Clear(int reactions)
+{
+    memset(materials, 0, sizeof(materials));
+    this->reactions.assign(reactions, 0);
+}
+
+void Profile::Add(const Profile &other)
+{
+    for(int t = 0; t < MAX_MATERIALS; t++)
+    {
+        materials[t].visited += other.materials[t].visited;
+        materials[t].moved += other.materials[t].moved;
+        materials[t].sampled += other.materials[t].sampled;
+        materials[t].sampledSeconds += other.materials[t].sampledSeconds;
+    }
+
+    if(reactions.size() < other.reactions.size())
+        reactions.resize(other.reactions.size(), 0);
+    for(size_t i = 0; i < other.reactions.size(); i++)
+        reactions[i] += other.reactions[i];
+}
+
+double Profile::GetSeconds(int type) const
+{
+    const MaterialProfile &profile = materials[type];
+    return profile.sampled > 0 ? profile.sampledSeconds * profile.visited / profile.sampled : 0;
+}
+
+static std::string MaterialName(const Materials &materials, int type)
+{
+    if(materials.IsDefined(type))
+        return materials.GetName(type);
+    return "#" + std::to_string(type);
+}
+
+void Profile::Print(FILE *file, const Materials &materials) const
+{
+    static const char *PICK_NAMES[] = { "each", "any", "one", "self" };
+
+    std::vector<int> types;
+    double total = 0;
+    for(int t = 0; t < MAX_MATERIALS; t++)
+    {
+        if(this->materials[t].visited == 0)
+            continue;
+        types.push_back(t);
+        total += GetSeconds(t);
+    }
+    std::sort(types.begin(), types.end(), [this](int a, int b) { return GetSeconds(a) > GetSeconds(b); });
+
+    fprintf(file, "%-12s %14s %14s %7s %10s %6s %9s\n", "material", "updates", "moved", "moved%", "est. ms", "time%", "ns/update");
+    for(int t : types)
+    {
+        const MaterialProfile &profile = this->materials[t];
+        double seconds = GetSeconds(t);
+        fprintf(file, "%-12s %14llu %14llu %6.1f%% %10.1f %5.1f%% %9.1f\n",
+                MaterialName(materials, t).c_str(),
+                (unsigned long long)profile.visited, (unsigned long long)profile.moved,
+                100.0 * profile.moved / profile.visited,
+                seconds * 1000.0, total > 0 ? 100.0 * seconds / total : 0.0,
+                profile.sampled > 0 ? profile.sampledSeconds * 1e9 / profile.sampled : 0.0);
+    }
+
+    //Reactions of the table the counters were collected with
+    struct Fired
+    {
+        int type;
+        int rule;
+        const Reaction *reaction;
+        uint64_t count;
+    };
+    std::vector<Fired> fired;
+    for(int t = 0; t < MAX_MATERIALS; t++)
+    {
+        int rule = 0;
+        for(const Reaction *reaction = materials.FirstReaction(t); reaction != materials.EndReaction(t); reaction++, rule++)
+        {
+            size_t index = materials.GetReactionIndex(reaction);
+            if(index < reactions.size() && reactions[index] > 0)
+                fired.push_back({ t, rule, reaction, reactions[index] });
+        }
+    }
+    std::sort(fired.begin(), fired.end(), [](const Fired &a, const Fired &b) { return a.count > b.count; });
+
+    fprintf(file, "\n%-24s %14s %14s\n", "reaction", "fired", "per update");
+    for(const Fired &f : fired)
+    {
+        std::string name = MaterialName(materials, f.type) + " rule " + std::to_string(f.rule + 1) + " (" + PICK_NAMES[f.reaction->pick] + ")";
+        fprintf(file, "%-24s %14llu %14.4f\n", name.c_str(), (unsigned long long)f.count,
+                this->materials[f.type].visited > 0 ? (double)f.count / this->materials[f.type].visited : 0.0);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_PROFILE_H
+#define SDLSAND_PROFILE_H
+
+// What the particle update spends its time on, per material and per
+// reaction. The counters are only collected by a core built with
+// SAND_PROFILE (cmake -DSAND_PROFILE=ON); otherwise they stay at zero and
+// the update carries no extra work.
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "Materials.h"
+
+//Every PROFILE_SAMPLE_INTERVAL-th particle update is timed. The times
+//include reading the clock, so they are for comparing materials with each
+//other rather than absolute.
+const int PROFILE_SAMPLE_INTERVAL = 64;
+
+struct MaterialProfile
+{
+    uint64_t visited;       //particles of the material updated
+    uint64_t moved;         //updates that moved the particle or changed a cell
+    uint64_t sampled;       //updates timed
+    double sampledSeconds;  //what the timed updates took
+};
+
+class Profile
+{
+public:
+    Profile();
+
+    //Zeroes everything, with a counter for each of reactions reactions
+    void Clear(int reactions);
+
+    void Add(const Profile &other);
+
+    //Estimated time spent on the material: its sampled time scaled up to
+    //all of its updates
+    double GetSeconds(int type) const;
+
+    //Materials by estimated time, then reactions by how often they fired
+    void Print(FILE *file, const Materials &materials) const;
+
+    MaterialProfile materials[MAX_MATERIALS];
+
+    //Times every reaction happened, by Materials::GetReactionIndex()
+    std::vector<uint64_t> reactions;
+};
+
+#endif //SDLSAND_PROFILE_H
@@ -0,0 +1,239 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "Recording.h"
+
+static const char *const RECORDING_MAGIC = "sdl2sand-recording";
+static const int RECORDING_VERSION = 2;
+
+//Larger worlds than this are taken for a corrupt file rather than allocated
+static const int RECORDING_MAX_SIZE = 16384;
+
+Recorder::Recorder()
+{
+    mFile = nullptr;
+}
+
+Recorder::~Recorder()
+{
+    Close();
+}
+
+bool Recorder::Open(const std::string &path, const World &world, std::string &error)
+{
+    Close();
+    mFile = fopen(path.c_str(), "w");
+    if(!mFile)
+    {
+        error = "Can't write " + path;
+        return false;
+    }
+
+    fprintf(mFile, "%s %d\n", RECORDING_MAGIC, RECORDING_VERSION);
+    fprintf(mFile, "world %d %d %u %s\n", world.GetWidth(), world.GetHeight(), world.GetSeed(),
+            world.GetRandomMode() == RANDOM_COUNTER ? "counter" : "bands");
+    fprintf(mFile, "materials %016llx\n", (unsigned long long)world.GetMaterials().GetHash());
+    return true;
+}
+
+void Recorder::Close()
+{
+    if(mFile)
+    {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+void Recorder::Clear()
+{
+    if(mFile)
+        fputs("clear\n", mFile);
+}
+
+void Recorder::Emit(int x, int width, ParticleType type, float p)
+{
+    //%.9g reads back as the very same float
+    if(mFile)
+        fprintf(mFile, "emit %d %d %d %.9g\n", x, width, (int)type, p);
+}
+
+void Recorder::PaintLine(int newx, int newy, int oldx, int oldy, int radius, ParticleType type)
+{
+    if(mFile)
+        fprintf(mFile, "line %d %d %d %d %d %d\n", newx, newy, oldx, oldy, radius, (int)type);
+}
+
+void Recorder::Step()
+{
+    if(mFile)
+        fputs("step\n", mFile);
+}
+
+bool Recording::Load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path.c_str());
+    if(!file)
+    {
+        error = "Can't open " + path;
+        return false;
+    }
+
+    int line = 0;
+    auto Fail = [&](const std::string &message)
+    {
+        std::ostringstream out;
+        out << path << ":" << line << ": " << message;
+        error = out.str();
+        return false;
+    };
+
+    mEvents.clear();
+    mFrames.clear();
+    mHasMaterialsHash = false;
+    mMaterialsHash = 0;
+    size_t frameStart = 0;
+    bool haveWorld = false;
+
+    std::string row;
+    while(std::getline(file, row))
+    {
+        line++;
+
+        std::istringstream in(row);
+        std::string keyword;
+        if(!(in >> keyword))
+            continue;
+
+        if(line == 1)
+        {
+            int version;
+            if(keyword != RECORDING_MAGIC || !(in >> version))
+                return Fail("Not a recording");
+            if(version < 1 || version > RECORDING_VERSION)
+                return Fail("Unsupported recording version");
+            continue;
+        }
+
+        Event event;
+        int type = 0;
+        if(keyword == "world")
+        {
+            std::string mode;
+            if(!(in >> mWidth >> mHeight >> mSeed >> mode) || mWidth < 3 || mHeight < 3)
+                return Fail("Expected: world <width> <height> <seed> <bands|counter>");
+            if(mWidth > RECORDING_MAX_SIZE || mHeight > RECORDING_MAX_SIZE)
+                return Fail("World sizes go up to " + std::to_string(RECORDING_MAX_SIZE));
+            if(mode == "bands")
+                mRandomMode = RANDOM_BANDS;
+            else if(mode == "counter")
+                mRandomMode = RANDOM_COUNTER;
+            else
+                return Fail("Unknown random mode " + mode);
+            haveWorld = true;
+            continue;
+        }
+        else if(keyword == "materials")
+        {
+            unsigned long long hash;
+            if(!(in >> std::hex >> hash))
+                return Fail("Expected: materials <hash>");
+            mMaterialsHash = hash;
+            mHasMaterialsHash = true;
+            continue;
+        }
+        else if(keyword == "line")
+        {
+            event.type = EVENT_LINE;
+            if(!(in >> event.args[0] >> event.args[1] >> event.args[2] >> event.args[3] >> event.args[4] >> type))
+                return Fail("Expected: line <newx> <newy> <oldx> <oldy> <radius> <type>");
+        }
+        else if(keyword == "emit")
+        {
+            event.type = EVENT_EMIT;
+            if(!(in >> event.args[0] >> event.args[1] >> type >> event.p))
+                return Fail("Expected: emit <x> <width> <type> <density>");
+        }
+        else if(keyword == "clear")
+        {
+            event.type = EVENT_CLEAR;
+        }
+        else if(keyword == "step")
+        {
+            mFrames.push_back(frameStart);
+            frameStart = mEvents.size();
+            continue;
+        }
+        else
+        {
+            return Fail("Unknown event " + keyword);
+        }
+
+        if(!haveWorld)
+            return Fail("Event before the world line");
+        if(type < 0 || type >= MATERIAL_BORDER)
+            return Fail("Material ids go from 0 to 62");
+        if(event.type == EVENT_LINE && (event.args[4] < 0 || event.args[4] > std::max(mWidth, mHeight)))
+            return Fail("Line radius out of range");
+        event.particle = (ParticleType)type;
+        mEvents.push_back(event);
+    }
+
+    if(line == 0 || !haveWorld)
+        return Fail("Not a recording");
+
+    //A session quit in the middle of a frame, that frame never ran
+    mEvents.resize(frameStart);
+    return true;
+}
+
+void Recording::Start(World &world) const
+{
+    world.Seed(mSeed);
+    world.SetRandomMode(mRandomMode);
+}
+
+void Recording::PlayFrame(World &world, int frame) const
+{
+    size_t end = frame+1 < (int)mFrames.size() ? mFrames[frame+1] : mEvents.size();
+    for(size_t i = mFrames[frame]; i < end; i++)
+    {
+        const Event &event = mEvents[i];
+        switch(event.type)
+        {
+            case EVENT_LINE:
+                world.PaintLine(event.args[0], event.args[1], event.args[2], event.args[3], event.args[4], event.particle);
+                break;
+            case EVENT_EMIT:
+                world.Emit(event.args[0], event.args[1], event.particle, event.p);
+                break;
+            case EVENT_CLEAR:
+                world.Clear();
+                break;
+        }
+    }
+    world.Step();
+}
@@ -0,0 +1,126 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_RECORDING_H
+#define SDLSAND_RECORDING_H
+
+// Recording everything that changes the world from the outside (paint
+// strokes, emitters, clearing) frame by frame, so a session can be replayed
+// without a window and reproduce the same grid step for step.
+//
+// The file is plain text, one line per event:
+//
+//   sdl2sand-recording 2
+//   world <width> <height> <seed> <bands|counter>   (sizes up to 16384)
+//   materials <hash>           (Materials::GetHash() of the table, in hex)
+//   line <newx> <newy> <oldx> <oldy> <radius> <type>  (radius up to the larger size)
+//   emit <x> <width> <type> <density>
+//   clear
+//   step                       (ends a frame)
+//
+// Types are material ids. The materials table itself isn't recorded, only its
+// hash; replay with the same -materials file the game ran with. Version 1
+// recordings have no materials line.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "World.h"
+
+//Writes the input of a session to a file, next to applying it to the world
+class Recorder
+{
+public:
+    Recorder();
+    ~Recorder();
+
+    //Starts a recording of world, which has just been seeded
+    bool Open(const std::string &path, const World &world, std::string &error);
+    void Close();
+    bool IsOpen() const { return mFile != nullptr; }
+
+    void Clear();
+    void Emit(int x, int width, ParticleType type, float p);
+    void PaintLine(int newx, int newy, int oldx, int oldy, int radius, ParticleType type);
+
+    //Ends the frame, called right before World::Step()
+    void Step();
+
+private:
+    Recorder(const Recorder &);
+    Recorder &operator=(const Recorder &);
+
+    FILE *mFile;
+};
+
+//A recording read back into memory
+class Recording
+{
+public:
+    bool Load(const std::string &path, std::string &error);
+
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+    int GetFrames() const { return (int)mFrames.size(); }
+
+    //Hash of the material table the session ran with, if it was recorded
+    bool HasMaterialsHash() const { return mHasMaterialsHash; }
+    uint64_t GetMaterialsHash() const { return mMaterialsHash; }
+
+    //Seeds a freshly created GetWidth() x GetHeight() world like the
+    //recorded one
+    void Start(World &world) const;
+
+    //Applies the input of a frame to the world and steps it
+    void PlayFrame(World &world, int frame) const;
+
+private:
+    enum EventType
+    {
+        EVENT_LINE,
+        EVENT_EMIT,
+        EVENT_CLEAR
+    };
+
+    struct Event
+    {
+        EventType type;
+        int args[5];
+        ParticleType particle;
+        float p;
+    };
+
+    int mWidth;
+    int mHeight;
+    unsigned int mSeed;
+    RandomMode mRandomMode;
+    bool mHasMaterialsHash;
+    uint64_t mMaterialsHash;
+    std::vector<Event> mEvents;
+
+    //Index of the first event of every frame, the frame ends where the
+    //next one starts
+    std::vector<size_t> mFrames;
+};
+
+#endif //SDLSAND_RECORDING_H
@@ -0,0 +1,196 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include "RowScan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(SAND_NO_SIMD) && !defined(SAND_WIDE_CELLS)
+#define ROWSCAN_X86
+#include <immintrin.h>
+#endif
+
+#ifndef ROWSCAN_X86
+#ifdef SAND_WIDE_CELLS
+
+static int ForwardScalar(const Cell *row, int x, int end)
+{
+    while(x <= end && row[x] == NOTHING)
+        x++;
+    return x;
+}
+
+static int BackwardScalar(const Cell *row, int x, int begin)
+{
+    while(x >= begin && row[x] == NOTHING)
+        x--;
+    return x;
+}
+
+#else
+
+//High bit set in every byte of v that isn't zero
+static inline uint64_t NonZeroBytes(uint64_t v)
+{
+    const uint64_t low7 = 0x7F7F7F7F7F7F7F7Full;
+    return (((v & low7) + low7) | v) & ~low7;
+}
+
+//Eight cells at a time, as one 64 bit integer (little endian: the first
+//cell is the lowest byte)
+static int ForwardScalar(const Cell *row, int x, int end)
+{
+    for(; x + 8 <= end + 1; x += 8)
+    {
+        uint64_t v;
+        memcpy(&v, row + x, 8);
+        if(v)
+            return x + (__builtin_ctzll(NonZeroBytes(v)) >> 3);
+    }
+    while(x <= end && row[x] == NOTHING)
+        x++;
+    return x;
+}
+
+static int BackwardScalar(const Cell *row, int x, int begin)
+{
+    for(; x - 7 >= begin; x -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, row + x - 7, 8);
+        if(v)
+            return x - (__builtin_clzll(NonZeroBytes(v)) >> 3);
+    }
+    while(x >= begin && row[x] == NOTHING)
+        x--;
+    return x;
+}
+
+#endif
+#endif
+
+#ifdef ROWSCAN_X86
+
+//Bit i set where cell i of the 16 is not empty
+static inline unsigned int Occupied16(const Cell *cells)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)cells);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) ^ 0xFFFF;
+}
+
+static int ForwardSSE2(const Cell *row, int x, int end)
+{
+    for(; x + 16 <= end + 1; x += 16)
+    {
+        unsigned int mask = Occupied16(row + x);
+        if(mask)
+            return x + __builtin_ctz(mask);
+    }
+    while(x <= end && row[x] == NOTHING)
+        x++;
+    return x;
+}
+
+static int BackwardSSE2(const Cell *row, int x, int begin)
+{
+    for(; x - 15 >= begin; x -= 16)
+    {
+        unsigned int mask = Occupied16(row + x - 15);
+        if(mask)
+            return x - 15 + (31 - __builtin_clz(mask));
+    }
+    while(x >= begin && row[x] == NOTHING)
+        x--;
+    return x;
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int Occupied32(const Cell *cells)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)cells);
+    return ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+}
+
+__attribute__((target("avx2")))
+static int ForwardAVX2(const Cell *row, int x, int end)
+{
+    for(; x + 32 <= end + 1; x += 32)
+    {
+        unsigned int mask = Occupied32(row + x);
+        if(mask)
+            return x + __builtin_ctz(mask);
+    }
+    return ForwardSSE2(row, x, end);
+}
+
+__attribute__((target("avx2")))
+static int BackwardAVX2(const Cell *row, int x, int begin)
+{
+    for(; x - 31 >= begin; x -= 32)
+    {
+        unsigned int mask = Occupied32(row + x - 31);
+        if(mask)
+            return x - 31 + (31 - __builtin_clz(mask));
+    }
+    return BackwardSSE2(row, x, begin);
+}
+
+#endif
+
+typedef int (*ScanFunction)(const Cell *row, int x, int limit);
+
+static ScanFunction PickForward()
+{
+#ifdef ROWSCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return ForwardAVX2;
+    return ForwardSSE2;
+#else
+    return ForwardScalar;
+#endif
+}
+
+static ScanFunction PickBackward()
+{
+#ifdef ROWSCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return BackwardAVX2;
+    return BackwardSSE2;
+#else
+    return BackwardScalar;
+#endif
+}
+
+static const ScanFunction forward = PickForward();
+static const ScanFunction backward = PickBackward();
+
+int FindOccupied(const Cell *row, int x, int end)
+{
+    return forward(row, x, end);
+}
+
+int FindOccupiedBackward(const Cell *row, int x, int begin)
+{
+    return backward(row, x, begin);
+}
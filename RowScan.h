@@ -0,0 +1,40 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SDLSAND_ROWSCAN_H
+#define SDLSAND_ROWSCAN_H
+
+// Finding the particles in a row of the grid. Rows are often mostly empty,
+// so instead of visiting every cell these skip runs of NOTHING 16 (SSE2) or
+// 32 (AVX2) cells at a time, or 8 at a time with plain 64 bit integers on
+// other CPUs. The best version the CPU supports is picked at startup;
+// define SAND_NO_SIMD to always use the plain one.
+
+#include "World.h"
+
+//First non-empty cell in row[x..end], end+1 if there is none
+int FindOccupied(const Cell *row, int x, int end);
+
+//Last non-empty cell in row[begin..x], begin-1 if there is none
+int FindOccupiedBackward(const Cell *row, int x, int begin);
+
+#endif //SDLSAND_ROWSCAN_H
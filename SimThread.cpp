@@ -0,0 +1,343 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "Recording.h"
+#include "SimThread.h"
+#include "Trace.h"
+
+SimThread::SimThread(World &world, int viewWidth, int viewHeight, double ticksPerSecond, int maxTicks, Recorder *recorder)
+    : mWorld(world), mTimestep(ticksPerSecond, maxTicks)
+{
+    //No bigger than the world
+    mViewWidth = viewWidth < world.GetWidth() ? viewWidth : world.GetWidth();
+    mViewHeight = viewHeight < world.GetHeight() ? viewHeight : world.GetHeight();
+    mRecorder = recorder;
+    mQuit = false;
+    mTicks = 0;
+    memset(&mInput, 0, sizeof(mInput));
+    mHead = 0;
+    mTail = 0;
+
+    for(int i = 0; i < 3; i++)
+        mGrids[i].assign((size_t)mViewWidth * mViewHeight, NOTHING);
+    memset(mCounts, 0, sizeof(mCounts));
+    memset(mTimes, 0, sizeof(mTimes));
+    memset(&mPendingTimes, 0, sizeof(mPendingTimes));
+    for(int i = 0; i < 3; i++)
+    {
+        mChanges[i].frame = 0;
+        mChanges[i].viewX = 0;
+        mChanges[i].viewY = 0;
+        mChanges[i].since = 0;
+    }
+    mPublished = 0;
+    mAcquired = 0;
+    mChunkChanged.assign((size_t)world.GetChunksX() * world.GetChunksY(), 0);
+    mFront = 0;
+    mMiddle = 1;
+    mBack = 2;
+}
+
+SimThread::~SimThread()
+{
+    Stop();
+}
+
+void SimThread::Start()
+{
+    if(mThread.joinable())
+        return;
+
+    //Something to draw before the first tick, with the input queued so far
+    RunCommands();
+    Publish();
+
+    mQuit = false;
+    mThread = std::thread(&SimThread::Run, this);
+}
+
+void SimThread::Stop()
+{
+    if(!mThread.joinable())
+        return;
+
+    mQuit = true;
+    mThread.join();
+}
+
+void SimThread::Push(const Command &command)
+{
+    unsigned int tail = mTail.load(std::memory_order_relaxed);
+
+    //Full - the simulation drains the queue every tick, so this is short
+    while(tail - mHead.load(std::memory_order_acquire) >= QUEUE_SIZE)
+        std::this_thread::yield();
+
+    mCommands[tail & (QUEUE_SIZE-1)] = command;
+    mTail.store(tail + 1, std::memory_order_release);
+}
+
+void SimThread::PaintLine(int newx, int newy, int oldx, int oldy, int radius, ParticleType type)
+{
+    Command command;
+    command.type = COMMAND_LINE;
+    command.args[0] = newx;
+    command.args[1] = newy;
+    command.args[2] = oldx;
+    command.args[3] = oldy;
+    command.args[4] = radius;
+    command.particle = type;
+    Push(command);
+}
+
+void SimThread::Clear()
+{
+    Command command;
+    command.type = COMMAND_CLEAR;
+    Push(command);
+}
+
+void SimThread::SetInput(const SimInput &input)
+{
+    Command command;
+    command.type = COMMAND_INPUT;
+    command.input = input;
+    Push(command);
+}
+
+// Applying everything queued up since the last tick
+void SimThread::RunCommands()
+{
+    unsigned int head = mHead.load(std::memory_order_relaxed);
+    unsigned int tail = mTail.load(std::memory_order_acquire);
+
+    for(; head != tail; head++)
+    {
+        const Command &command = mCommands[head & (QUEUE_SIZE-1)];
+        switch(command.type)
+        {
+            case COMMAND_LINE:
+                mWorld.PaintLine(command.args[0], command.args[1], command.args[2], command.args[3], command.args[4], command.particle);
+                if(mRecorder)
+                    mRecorder->PaintLine(command.args[0], command.args[1], command.args[2], command.args[3], command.args[4], command.particle);
+                break;
+            case COMMAND_CLEAR:
+                mWorld.Clear();
+                if(mRecorder)
+                    mRecorder->Clear();
+                break;
+            case COMMAND_INPUT:
+                mInput = command.input;
+                break;
+        }
+    }
+
+    mHead.store(head, std::memory_order_release);
+}
+
+void SimThread::Tick()
+{
+    TraceZone tickZone("tick");
+    auto start = std::chrono::steady_clock::now();
+    int64_t traceStart = Trace::Now();
+
+    RunCommands();
+
+    //To emit or not to emit
+    for(int i = 0; i < SIM_EMITTERS; i++)
+    {
+        const SimEmitter &emitter = mInput.emitters[i];
+        if(!emitter.on)
+            continue;
+        mWorld.Emit(emitter.x, emitter.width, emitter.type, emitter.density);
+        if(mRecorder)
+            mRecorder->Emit(emitter.x, emitter.width, emitter.type, emitter.density);
+    }
+
+    //Holding the button down keeps painting (enabeling 'dynamic emitters')
+    if(mInput.brushDown)
+    {
+        mWorld.PaintLine(mInput.brushX, mInput.brushY, mInput.brushX, mInput.brushY, mInput.brushRadius, mInput.brushType);
+        if(mRecorder)
+            mRecorder->PaintLine(mInput.brushX, mInput.brushY, mInput.brushX, mInput.brushY, mInput.brushRadius, mInput.brushType);
+    }
+
+    if(mRecorder)
+        mRecorder->Step();
+
+    auto step = std::chrono::steady_clock::now();
+    Trace::Add("emit", traceStart, Trace::Now());
+    mWorld.Step();
+    auto end = std::chrono::steady_clock::now();
+
+    mPendingTimes.ticks++;
+    mPendingTimes.emitSeconds += std::chrono::duration<double>(step - start).count();
+    mPendingTimes.stepSeconds += std::chrono::duration<double>(end - step).count();
+
+    mTicks.fetch_add(1, std::memory_order_release);
+}
+
+// Handing the visible part of the grid to the renderer
+void SimThread::Publish()
+{
+    TraceZone zone("publish");
+
+    int viewX = mInput.viewX;
+    int viewY = mInput.viewY;
+    if(viewX > mWorld.GetWidth() - mViewWidth)
+        viewX = mWorld.GetWidth() - mViewWidth;
+    if(viewX < 0)
+        viewX = 0;
+    if(viewY > mWorld.GetHeight() - mViewHeight)
+        viewY = mWorld.GetHeight() - mViewHeight;
+    if(viewY < 0)
+        viewY = 0;
+
+    const Cell *cells = mWorld.GetCells() + viewX + mWorld.GetStride()*viewY;
+    for(int y = 0; y < mViewHeight; y++)
+        memcpy(&mGrids[mBack][(size_t)mViewWidth*y], cells + mWorld.GetStride()*y, mViewWidth * sizeof(Cell));
+    for(int t = 0; t < MAX_MATERIALS; t++)
+        mCounts[mBack][t] = mWorld.GetCount((ParticleType)t);
+    mTimes[mBack] = mPendingTimes;
+    memset(&mPendingTimes, 0, sizeof(mPendingTimes));
+
+    SimChanges &changes = mChanges[mBack];
+    changes.frame = ++mPublished;
+    changes.viewX = viewX;
+    changes.viewY = viewY;
+    FindChanges(changes);
+
+    mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+bool SimThread::AcquireFrame()
+{
+    if(!(mMiddle.load(std::memory_order_relaxed) & FRESH))
+        return false;
+
+    mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & ~FRESH;
+    mAcquired.store(mChanges[mFront].frame, std::memory_order_release);
+    return true;
+}
+
+// Listing the chunks in view that changed since the last frame the
+// renderer took, as rectangles in frame coordinates. The renderer may take
+// a newer frame meanwhile, which only makes the list longer than needed.
+void SimThread::FindChanges(SimChanges &changes)
+{
+    //Beyond this many rectangles one around all of them is cheaper
+    const size_t MAX_RECTS = 16;
+
+    changes.since = mAcquired.load(std::memory_order_acquire);
+    changes.rects.clear();
+
+    int cx0 = changes.viewX / CHUNK_SIZE;
+    int cy0 = changes.viewY / CHUNK_SIZE;
+    int cx1 = (changes.viewX + mViewWidth - 1) / CHUNK_SIZE;
+    int cy1 = (changes.viewY + mViewHeight - 1) / CHUNK_SIZE;
+
+    for(int cy = cy0; cy <= cy1; cy++)
+    {
+        int y0 = cy*CHUNK_SIZE > changes.viewY ? cy*CHUNK_SIZE - changes.viewY : 0;
+        int y1 = (cy+1)*CHUNK_SIZE - changes.viewY < mViewHeight ? (cy+1)*CHUNK_SIZE - changes.viewY : mViewHeight;
+        size_t row = changes.rects.size();
+
+        for(int cx = cx0; cx <= cx1; cx++)
+        {
+            unsigned int &changed = mChunkChanged[cx + mWorld.GetChunksX()*cy];
+            if(mWorld.TakeChanged(cx, cy))
+                changed = changes.frame;
+            if(changed <= changes.since)
+                continue;
+
+            //Runs of changed chunks side by side make one rectangle
+            int x0 = cx*CHUNK_SIZE > changes.viewX ? cx*CHUNK_SIZE - changes.viewX : 0;
+            int x1 = (cx+1)*CHUNK_SIZE - changes.viewX < mViewWidth ? (cx+1)*CHUNK_SIZE - changes.viewX : mViewWidth;
+            if(changes.rects.size() > row && changes.rects.back().x + changes.rects.back().w == x0)
+                changes.rects.back().w = x1 - changes.rects.back().x;
+            else
+                changes.rects.push_back({ x0, y0, x1 - x0, y1 - y0 });
+        }
+
+        //and a rectangle ending right above one of them with the same sides
+        //grows downwards
+        for(size_t i = row; i < changes.rects.size(); )
+        {
+            const SimRect &rect = changes.rects[i];
+            size_t above = 0;
+            while(above < row && !(changes.rects[above].x == rect.x && changes.rects[above].w == rect.w
+                                   && changes.rects[above].y + changes.rects[above].h == rect.y))
+                above++;
+
+            if(above < row)
+            {
+                changes.rects[above].h += rect.h;
+                changes.rects.erase(changes.rects.begin() + i);
+            }
+            else
+                i++;
+        }
+    }
+
+    if(changes.rects.size() > MAX_RECTS)
+    {
+        SimRect all = changes.rects[0];
+        for(const SimRect &rect : changes.rects)
+        {
+            int x1 = std::max(all.x + all.w, rect.x + rect.w);
+            int y1 = std::max(all.y + all.h, rect.y + rect.h);
+            all.x = std::min(all.x, rect.x);
+            all.y = std::min(all.y, rect.y);
+            all.w = x1 - all.x;
+            all.h = y1 - all.y;
+        }
+        changes.rects.assign(1, all);
+    }
+}
+
+void SimThread::Run()
+{
+    Trace::SetThreadName("simulation");
+
+    auto last = std::chrono::steady_clock::now();
+    while(!mQuit.load(std::memory_order_relaxed))
+    {
+        auto now = std::chrono::steady_clock::now();
+        int ticks = mTimestep.Advance(std::chrono::duration<double>(now - last).count());
+        last = now;
+
+        if(ticks == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(mTimestep.GetTimeToNextTick()));
+            continue;
+        }
+
+        for(int i = 0; i < ticks; i++)
+            Tick();
+        mPendingTimes.droppedTicks = mTimestep.GetDroppedTicks();
+        Publish();
+    }
+}
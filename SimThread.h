@@ -0,0 +1,224 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_SIMTHREAD_H
+#define SDLSAND_SIMTHREAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Timestep.h"
+#include "World.h"
+
+class Recorder;
+
+//An emitter pouring particles in at the top, as the game has four of
+struct SimEmitter
+{
+    int x;
+    int width;
+    ParticleType type;
+    float density;
+    bool on;
+};
+
+const int SIM_EMITTERS = 4;
+
+//What the player keeps doing from tick to tick, rather than once
+struct SimInput
+{
+    SimEmitter emitters[SIM_EMITTERS];
+
+    //Painting at (brushX,brushY) every tick while the button is held
+    bool brushDown;
+    int brushX;
+    int brushY;
+    int brushRadius;
+    ParticleType brushType;
+
+    //Top left corner of the part of the world handed to the renderer
+    int viewX;
+    int viewY;
+};
+
+//Time the simulation thread spent on the ticks since the previous frame
+struct SimTimes
+{
+    int ticks;
+    double emitSeconds;  //strokes, emitters and the held brush
+    double stepSeconds;  //World::Step()
+
+    //Ticks given up on since the start because the simulation couldn't
+    //keep up with the tick rate
+    long long droppedTicks;
+};
+
+//A rectangle of cells in a frame
+struct SimRect
+{
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+//Which part of the world a frame shows, and what changed in it
+struct SimChanges
+{
+    //Frames are numbered from 1 on
+    unsigned int frame;
+    int viewX;
+    int viewY;
+
+    //Cells that may differ from what frame since (or any later frame)
+    //showed of the same view. Every frame AcquireFrame() took is one of
+    //those, so a renderer keeping the frame it drew last only has to
+    //redo these.
+    unsigned int since;
+    std::vector<SimRect> rects;
+};
+
+// Steps a world on a thread of its own at a fixed tick rate, so drawing a
+// frame and simulating the next one overlap.
+//
+// The game thread talks to it through a single-producer single-consumer
+// command queue (strokes, clearing, input changes), applied at the start of
+// the next tick. Finished grids come back through a triple buffer: the
+// simulation always has a spare buffer to write into, and the renderer
+// picks up the most recent one without ever waiting. Neither side takes a
+// lock.
+//
+// Once started, only the simulation thread touches the world (and the
+// recorder) until Stop().
+class SimThread
+{
+public:
+    //The renderer gets viewWidth x viewHeight cells of the world, from
+    //where SimInput::viewX/viewY says
+    SimThread(World &world, int viewWidth, int viewHeight, double ticksPerSecond, int maxTicks, Recorder *recorder);
+    ~SimThread();
+
+    void Start();
+    void Stop();
+
+    //Commands from the game thread
+    void PaintLine(int newx, int newy, int oldx, int oldy, int radius, ParticleType type);
+    void Clear();
+    void SetInput(const SimInput &input);
+
+    //Takes the most recently finished grid for drawing, if there is a new
+    //one since the last call. GetFrame() stays valid until the next call.
+    //Rows of the frame are viewWidth cells apart.
+    bool AcquireFrame();
+    const Cell *GetFrame() const { return &mGrids[mFront][0]; }
+
+    //Cells per material id in the whole world at the time of the frame,
+    //MAX_MATERIALS of them (see World::GetCount)
+    const int *GetCounts() const { return mCounts[mFront]; }
+
+    //What the ticks that went into the frame took
+    const SimTimes &GetTimes() const { return mTimes[mFront]; }
+
+    //Where the frame is and what changed in it
+    const SimChanges &GetChanges() const { return mChanges[mFront]; }
+
+    //Ticks run so far
+    uint64_t GetTicks() const { return mTicks.load(std::memory_order_acquire); }
+
+private:
+    SimThread(const SimThread &);
+    SimThread &operator=(const SimThread &);
+
+    enum CommandType
+    {
+        COMMAND_LINE,
+        COMMAND_CLEAR,
+        COMMAND_INPUT
+    };
+
+    struct Command
+    {
+        CommandType type;
+        int args[5];
+        ParticleType particle;
+        SimInput input;
+    };
+
+    //Power of two, so the ring indices can wrap freely
+    static const unsigned int QUEUE_SIZE = 1024;
+
+    //Set in mMiddle when the buffer there hasn't been picked up yet
+    static const int FRESH = 4;
+
+    void Run();
+    void Push(const Command &command);
+    void RunCommands();
+    void Tick();
+    void Publish();
+    void FindChanges(SimChanges &changes);
+
+    World &mWorld;
+    int mViewWidth;
+    int mViewHeight;
+    Recorder *mRecorder;
+    Timestep mTimestep;
+
+    std::thread mThread;
+    std::atomic<bool> mQuit;
+    std::atomic<uint64_t> mTicks;
+
+    //What the last COMMAND_INPUT said, simulation thread only
+    SimInput mInput;
+
+    //Ticks run since the last Publish(), simulation thread only
+    SimTimes mPendingTimes;
+
+    //Command ring: the game thread writes at mTail, the simulation
+    //thread reads at mHead
+    Command mCommands[QUEUE_SIZE];
+    std::atomic<unsigned int> mHead;
+    std::atomic<unsigned int> mTail;
+
+    //Triple buffer. mBack belongs to the simulation thread, mFront to the
+    //renderer, and mMiddle (with FRESH) is swapped between them.
+    std::vector<Cell> mGrids[3];
+    int mCounts[3][MAX_MATERIALS];
+    SimTimes mTimes[3];
+    SimChanges mChanges[3];
+
+    //Frames published so far, and the number of the last one the renderer
+    //took
+    unsigned int mPublished;
+    std::atomic<unsigned int> mAcquired;
+
+    //Number of the last frame each chunk of the world changed in,
+    //simulation thread only
+    std::vector<unsigned int> mChunkChanged;
+    int mBack;
+    int mFront;
+    std::atomic<int> mMiddle;
+};
+
+#endif //SDLSAND_SIMTHREAD_H
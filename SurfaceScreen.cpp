@@ -0,0 +1,221 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "PixelConvert.h"
+#include "SurfaceScreen.h"
+
+//More rectangles than this are shown as one update of the whole window
+const int MAX_DAMAGE = 64;
+
+SurfaceScreen::SurfaceScreen(SDL_Window *window, int width, int height)
+    : mWindow(window), mSurface(nullptr), mShadow(nullptr), mTarget(nullptr),
+      mWidth(width), mHeight(height), mScale(1), mOffsetX(0), mOffsetY(0),
+      mVisibleWidth(0), mVisibleHeight(0), mAllDamaged(true)
+{
+    Reset();
+}
+
+SurfaceScreen::~SurfaceScreen()
+{
+    if(mShadow)
+        SDL_FreeSurface(mShadow);
+}
+
+void SurfaceScreen::Reset()
+{
+    if(mShadow)
+        SDL_FreeSurface(mShadow);
+    mShadow = nullptr;
+    mTarget = nullptr;
+    mDamage.clear();
+    mAllDamaged = true;
+
+    mSurface = SDL_GetWindowSurface(mWindow);
+    if(!mSurface)
+        return;
+
+    if(mSurface->format->BytesPerPixel == 4)
+        mTarget = mSurface;
+    else
+        mTarget = mShadow = SDL_CreateRGBSurfaceWithFormat(0, mSurface->w, mSurface->h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if(!mTarget)
+        return;
+
+    mScale = std::max(1, std::min(mTarget->w / mWidth, mTarget->h / mHeight));
+    mOffsetX = std::max(0, (mTarget->w - mWidth*mScale) / 2);
+    mOffsetY = std::max(0, (mTarget->h - mHeight*mScale) / 2);
+    mVisibleWidth = std::min(mWidth, mTarget->w / mScale);
+    mVisibleHeight = std::min(mHeight, mTarget->h / mScale);
+
+    SDL_FillRect(mTarget, nullptr, SDL_MapRGB(mTarget->format, 0, 0, 0));
+}
+
+Uint32 SurfaceScreen::GetFormat() const
+{
+    return mTarget ? mTarget->format->format : SDL_PIXELFORMAT_ARGB8888;
+}
+
+//Rounding down, also left of and above the screen
+static int FloorDiv(int a, int b)
+{
+    return (a >= 0 ? a : a - b + 1) / b;
+}
+
+void SurfaceScreen::ToLogical(Sint32 &x, Sint32 &y) const
+{
+    x = std::max(0, std::min(FloorDiv(x - mOffsetX, mScale), mWidth - 1));
+    y = std::max(0, std::min(FloorDiv(y - mOffsetY, mScale), mHeight - 1));
+}
+
+bool SurfaceScreen::Clip(const SDL_Rect &rect, SDL_Rect &clipped) const
+{
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.w, mVisibleWidth);
+    int y1 = std::min(rect.y + rect.h, mVisibleHeight);
+    if(!mTarget || x0 >= x1 || y0 >= y1)
+        return false;
+
+    clipped.x = x0;
+    clipped.y = y0;
+    clipped.w = x1 - x0;
+    clipped.h = y1 - y0;
+    return true;
+}
+
+//Top left window pixel of screen pixel (x,y)
+Uint32 *SurfaceScreen::Pixel(int x, int y) const
+{
+    return (Uint32 *)((Uint8 *)mTarget->pixels + mTarget->pitch*(mOffsetY + mScale*y)) + mOffsetX + mScale*x;
+}
+
+void SurfaceScreen::Damage(const SDL_Rect &rect)
+{
+    if(mAllDamaged)
+        return;
+    if((int)mDamage.size() == MAX_DAMAGE)
+    {
+        mAllDamaged = true;
+        return;
+    }
+
+    SDL_Rect window = { mOffsetX + mScale*rect.x, mOffsetY + mScale*rect.y, mScale*rect.w, mScale*rect.h };
+    mDamage.push_back(window);
+}
+
+void SurfaceScreen::FillRect(const SDL_Rect &rect, Uint32 color)
+{
+    SDL_Rect clipped;
+    if(!Clip(rect, clipped))
+        return;
+
+    if(SDL_MUSTLOCK(mTarget) && SDL_LockSurface(mTarget) != 0)
+        return;
+
+    Uint32 *row = Pixel(clipped.x, clipped.y);
+    for(int y = 0; y < clipped.h*mScale; y++)
+    {
+        std::fill_n(row, clipped.w*mScale, color);
+        row = (Uint32 *)((Uint8 *)row + mTarget->pitch);
+    }
+
+    if(SDL_MUSTLOCK(mTarget))
+        SDL_UnlockSurface(mTarget);
+    Damage(clipped);
+}
+
+void SurfaceScreen::DrawCells(const Cell *cells, int cellStride, const SDL_Rect &rect, const Uint32 *palette)
+{
+    SDL_Rect clipped;
+    if(!Clip(rect, clipped))
+        return;
+    cells += cellStride*(clipped.y - rect.y) + (clipped.x - rect.x);
+
+    if(SDL_MUSTLOCK(mTarget) && SDL_LockSurface(mTarget) != 0)
+        return;
+
+    const int pitch = mTarget->pitch;
+    if(mScale == 1)
+    {
+        GetCellConverter()(cells, cellStride, clipped.w, clipped.h, palette, Pixel(clipped.x, clipped.y), pitch);
+    }
+    else
+    {
+        //Converting first, then widening every pixel and repeating every
+        //row mScale times
+        const int w = clipped.w;
+        mPixels.resize((size_t)w * clipped.h);
+        GetCellConverter()(cells, cellStride, w, clipped.h, palette, mPixels.data(), w*4);
+
+        for(int y = 0; y < clipped.h; y++)
+        {
+            const Uint32 *src = &mPixels[(size_t)w*y];
+            Uint32 *first = Pixel(clipped.x, clipped.y + y);
+
+            Uint32 *dst = first;
+            for(int x = 0; x < w; x++)
+            {
+                for(int i = 0; i < mScale; i++)
+                    *dst++ = src[x];
+            }
+
+            for(int i = 1; i < mScale; i++)
+                memcpy((Uint8 *)first + pitch*i, first, (size_t)w*mScale*4);
+        }
+    }
+
+    if(SDL_MUSTLOCK(mTarget))
+        SDL_UnlockSurface(mTarget);
+    Damage(clipped);
+}
+
+void SurfaceScreen::Present()
+{
+    if(!mTarget)
+        return;
+
+    if(mAllDamaged)
+    {
+        if(mShadow)
+            SDL_BlitSurface(mShadow, nullptr, mSurface, nullptr);
+        SDL_UpdateWindowSurface(mWindow);
+    }
+    else if(!mDamage.empty())
+    {
+        if(mShadow)
+        {
+            for(const SDL_Rect &rect : mDamage)
+            {
+                SDL_Rect to = rect;
+                SDL_BlitSurface(mShadow, &rect, mSurface, &to);
+            }
+        }
+        SDL_UpdateWindowSurfaceRects(mWindow, mDamage.data(), (int)mDamage.size());
+    }
+
+    mDamage.clear();
+    mAllDamaged = false;
+}
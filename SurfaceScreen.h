@@ -0,0 +1,104 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_SURFACESCREEN_H
+#define SDLSAND_SURFACESCREEN_H
+
+// Drawing without a renderer: the CPU paints straight into the window
+// surface, every pixel of the game's screen scaled up to a square of whole
+// window pixels. Without a GPU this is a lot cheaper than SDL's software
+// renderer, which would upload the scene to a texture, stretch it and fill
+// every rectangle on its own.
+
+#include <vector>
+#include "SDL.h"
+#include "World.h"
+
+class SurfaceScreen
+{
+public:
+    //A width x height screen on the surface of window, scaled up as far as
+    //whole multiples fit and centred, with black bars around it
+    SurfaceScreen(SDL_Window *window, int width, int height);
+    ~SurfaceScreen();
+
+    //False when the window has no surface to draw into
+    bool IsValid() const { return mTarget != nullptr; }
+
+    //Takes the window surface again after the window changed size. The
+    //window is black afterwards, everything has to be drawn again.
+    void Reset();
+
+    //The pixel format colors have to be packed in
+    Uint32 GetFormat() const;
+
+    //Turns window coordinates (of mouse events) into screen ones. Points in
+    //the black bars end up on the nearest edge of the screen.
+    void ToLogical(Sint32 &x, Sint32 &y) const;
+
+    //Fills a rectangle of the screen with a packed color
+    void FillRect(const SDL_Rect &rect, Uint32 color);
+
+    //Draws the cells of rect as palette[cell]. cells is the top left cell
+    //of the rectangle, rows are cellStride cells apart.
+    void DrawCells(const Cell *cells, int cellStride, const SDL_Rect &rect, const Uint32 *palette);
+
+    //Shows what was drawn since the last call
+    void Present();
+
+private:
+    SurfaceScreen(const SurfaceScreen &);
+    SurfaceScreen &operator=(const SurfaceScreen &);
+
+    bool Clip(const SDL_Rect &rect, SDL_Rect &clipped) const;
+    Uint32 *Pixel(int x, int y) const;
+    void Damage(const SDL_Rect &rect);
+
+    SDL_Window *mWindow;
+
+    //The window surface, a 32 bit copy of it when it has a different depth
+    //(blitted on Present), and the one of the two that is drawn into
+    SDL_Surface *mSurface;
+    SDL_Surface *mShadow;
+    SDL_Surface *mTarget;
+
+    int mWidth;
+    int mHeight;
+
+    //Window pixels per screen pixel, where the screen starts in the window
+    //and how much of it fits
+    int mScale;
+    int mOffsetX;
+    int mOffsetY;
+    int mVisibleWidth;
+    int mVisibleHeight;
+
+    //Window rectangles drawn since the last Present()
+    std::vector<SDL_Rect> mDamage;
+    bool mAllDamaged;
+
+    //Cells turned into pixels, before they are scaled up
+    std::vector<Uint32> mPixels;
+};
+
+#endif //SDLSAND_SURFACESCREEN_H
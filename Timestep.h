@@ -0,0 +1,76 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_TIMESTEP_H
+#define SDLSAND_TIMESTEP_H
+
+// Fixed-timestep scheduling: the simulation advances a fixed number of ticks
+// per second of wall time however long rendering takes. Feed it the time
+// that passed and run as many ticks as it returns.
+
+class Timestep
+{
+public:
+    //ticksPerSecond simulation ticks per second, at most maxTicks of them
+    //at once. When even that doesn't catch up, the rest is dropped and the
+    //simulation runs slower instead of falling further and further behind.
+    Timestep(double ticksPerSecond, int maxTicks)
+    {
+        mTickSeconds = 1.0 / ticksPerSecond;
+        mMaxTicks = maxTicks;
+        mAccumulator = 0;
+        mDroppedTicks = 0;
+    }
+
+    //Adds the seconds since the last call, returns the ticks to run now
+    int Advance(double seconds)
+    {
+        mAccumulator += seconds;
+        int ticks = (int)(mAccumulator / mTickSeconds);
+        if(ticks > mMaxTicks)
+        {
+            mDroppedTicks += ticks - mMaxTicks;
+            ticks = mMaxTicks;
+            mAccumulator = 0;
+        }
+        else
+        {
+            mAccumulator -= ticks * mTickSeconds;
+        }
+        return ticks;
+    }
+
+    //Seconds until the next tick is due
+    double GetTimeToNextTick() const { return mAccumulator < mTickSeconds ? mTickSeconds - mAccumulator : 0; }
+
+    //Ticks given up on because the machine couldn't keep up
+    long long GetDroppedTicks() const { return mDroppedTicks; }
+
+private:
+    double mTickSeconds;
+    int mMaxTicks;
+    double mAccumulator;
+    long long mDroppedTicks;
+};
+
+#endif //SDLSAND_TIMESTEP_H
@@ -0,0 +1,180 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Trace.h"
+
+namespace
+{
+    struct Event
+    {
+        const char *name;
+        const char *argName;
+        int arg;
+        int64_t begin;
+        int64_t end;
+    };
+
+    //What one thread collected. Only its own thread adds to it; the lock
+    //is there for Start() and Stop() running on another one.
+    struct ThreadEvents
+    {
+        int id;
+        std::string name;
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadEvents> > threads;
+    std::string outputPath;
+
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    //Kept when the thread ends, so its zones still get written
+    ThreadEvents &GetThreadEvents()
+    {
+        static thread_local ThreadEvents *events = nullptr;
+        if(!events)
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            threads.emplace_back(new ThreadEvents);
+            events = threads.back().get();
+            events->id = (int)threads.size();
+        }
+        return *events;
+    }
+
+    //Names are ours (zone names, thread names), so only quotes and
+    //backslashes need escaping
+    void WriteString(FILE *file, const char *text)
+    {
+        fputc('"', file);
+        for(; *text; text++)
+        {
+            if(*text == '"' || *text == '\\')
+                fputc('\\', file);
+            fputc(*text, file);
+        }
+        fputc('"', file);
+    }
+}
+
+namespace Trace
+{
+    std::atomic<bool> running(false);
+
+    bool Start(const std::string &path, std::string &error)
+    {
+        //Fail now rather than after the whole session
+        FILE *file = fopen(path.c_str(), "w");
+        if(!file)
+        {
+            error = "Unable to write " + path;
+            return false;
+        }
+        fclose(file);
+
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for(auto &thread : threads)
+        {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            thread->events.clear();
+        }
+        outputPath = path;
+        running.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Stop()
+    {
+        if(!running.exchange(false))
+            return false;
+
+        FILE *file = fopen(outputPath.c_str(), "w");
+        if(!file)
+            return false;
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for(auto &thread : threads)
+        {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+
+            if(!thread->name.empty())
+            {
+                fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",\n", thread->id);
+                WriteString(file, thread->name.c_str());
+                fprintf(file, "}}");
+                first = false;
+            }
+
+            for(const Event &event : thread->events)
+            {
+                fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                        first ? "" : ",\n", thread->id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+                WriteString(file, event.name);
+                if(event.argName)
+                {
+                    fprintf(file, ",\"args\":{");
+                    WriteString(file, event.argName);
+                    fprintf(file, ":%d}", event.arg);
+                }
+                fprintf(file, "}");
+                first = false;
+            }
+            thread->events.clear();
+        }
+
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+    int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void Add(const char *name, int64_t begin, int64_t end, const char *argName, int arg)
+    {
+        if(!IsRunning())
+            return;
+
+        ThreadEvents &thread = GetThreadEvents();
+        std::lock_guard<std::mutex> lock(thread.mutex);
+        thread.events.push_back({ name, argName, arg, begin, end });
+    }
+
+    void SetThreadName(const std::string &name)
+    {
+        ThreadEvents &thread = GetThreadEvents();
+        std::lock_guard<std::mutex> lock(thread.mutex);
+        thread.name = name;
+    }
+}
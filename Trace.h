@@ -0,0 +1,98 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef SDLSAND_TRACE_H
+#define SDLSAND_TRACE_H
+
+// Timeline tracing. While a trace is running, zones (a name, a start and an
+// end on some thread) are collected per thread; Trace::Stop() writes them as
+// Chrome trace-event JSON, which chrome://tracing and ui.perfetto.dev open
+// as they are.
+//
+//   Trace::Start("frames.json", error);
+//   {
+//       TraceZone zone("step");
+//       world.Step();
+//   }
+//   Trace::Stop();
+//
+// When no trace is running a zone costs a relaxed atomic load.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Trace
+{
+    //Starts collecting zones, to be written to path by Stop()
+    bool Start(const std::string &path, std::string &error);
+
+    //Writes everything collected since Start() and stops collecting
+    bool Stop();
+
+    //Set between Start() and Stop()
+    extern std::atomic<bool> running;
+
+    inline bool IsRunning() { return running.load(std::memory_order_relaxed); }
+
+    //Nanoseconds on the clock zones are timed with
+    int64_t Now();
+
+    //Adds a zone from begin to end (Now() times) on the calling thread,
+    //argName = arg shown with it unless argName is null. name and argName
+    //have to stay valid until Stop() - string literals in practice.
+    void Add(const char *name, int64_t begin, int64_t end, const char *argName = nullptr, int arg = 0);
+
+    //Names the calling thread in the trace
+    void SetThreadName(const std::string &name);
+}
+
+// A zone from construction to destruction
+class TraceZone
+{
+public:
+    explicit TraceZone(const char *name, const char *argName = nullptr, int arg = 0)
+    {
+        mName = name;
+        mArgName = argName;
+        mArg = arg;
+        mBegin = Trace::IsRunning() ? Trace::Now() : -1;
+    }
+
+    ~TraceZone()
+    {
+        if(mBegin >= 0)
+            Trace::Add(mName, mBegin, Trace::Now(), mArgName, mArg);
+    }
+
+private:
+    TraceZone(const TraceZone &);
+    TraceZone &operator=(const TraceZone &);
+
+    const char *mName;
+    const char *mArgName;
+    int mArg;
+    int64_t mBegin;
+};
+
+#endif //SDLSAND_TRACE_H
@@ -0,0 +1,129 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "Trace.h"
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(int threads)
+{
+    mTask = nullptr;
+    mCount = 0;
+    mNext = 0;
+    mFinished = 0;
+    mGeneration = 0;
+    mActive = 0;
+    mQuit = false;
+
+    for(int i = 1; i < threads; i++)
+        mWorkers.emplace_back(&WorkerPool::WorkerLoop, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+
+    for(std::thread &worker : mWorkers)
+        worker.join();
+}
+
+void WorkerPool::Run(int count, const std::function<void(int)> &task)
+{
+    if(count <= 0)
+        return;
+
+    //Nobody to share with - just do it here
+    if(mWorkers.empty() || count == 1)
+    {
+        for(int i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = &task;
+        mCount = count;
+        mNext = 0;
+        mFinished = 0;
+        mGeneration++;
+    }
+    mWake.notify_all();
+
+    Drain(task, count);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this, count] { return mFinished.load() == count && mActive == 0; });
+    mTask = nullptr;
+}
+
+// Takes tasks of the batch until there are none left
+void WorkerPool::Drain(const std::function<void(int)> &task, int count)
+{
+    int done = 0;
+    for(int i = mNext++; i < count; i = mNext++)
+    {
+        task(i);
+        done++;
+    }
+
+    if(done > 0 && mFinished.fetch_add(done) + done == count)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDone.notify_all();
+    }
+}
+
+void WorkerPool::WorkerLoop(int index)
+{
+    unsigned int seen = 0;
+    Trace::SetThreadName("worker " + std::to_string(index));
+
+    for(;;)
+    {
+        const std::function<void(int)> *task;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [this, seen] { return mQuit || mGeneration != seen; });
+            if(mQuit)
+                return;
+            seen = mGeneration;
+
+            //Woke up after the batch was over
+            task = mTask;
+            if(!task)
+                continue;
+            count = mCount;
+            mActive++;
+        }
+
+        Drain(*task, count);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(--mActive == 0)
+            mDone.notify_all();
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SDLSAND_WORKERPOOL_H
+#define SDLSAND_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run batches of independent tasks.
+// Run() hands out task indices 0..count-1 to the workers (the calling thread
+// helps too) and returns once every task of the batch has finished.
+class WorkerPool
+{
+public:
+    //Starts threads-1 workers; the caller is the last one
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    //Runs task(0) .. task(count-1) and waits for all of them
+    void Run(int count, const std::function<void(int)> &task);
+
+    int getThreads() const { return (int)mWorkers.size() + 1; }
+
+private:
+    WorkerPool(const WorkerPool &);
+    WorkerPool &operator=(const WorkerPool &);
+
+    void WorkerLoop(int index);
+    void Drain(const std::function<void(int)> &task, int count);
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+
+    //The batch being run, nullptr between batches
+    const std::function<void(int)> *mTask;
+    std::atomic<int> mCount;
+    std::atomic<int> mNext;
+    std::atomic<int> mFinished;
+
+    //Bumped for every batch so sleeping workers know there is new work
+    unsigned int mGeneration;
+
+    //Workers inside Drain(). Run() waits for them to leave, so none can
+    //take an index of one batch and run it in the next.
+    int mActive;
+    bool mQuit;
+};
+
+#endif //SDLSAND_WORKERPOOL_H
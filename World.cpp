@@ -0,0 +1,1082 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include "World.h"
+#include "WorkerPool.h"
+#include "RowScan.h"
+#include "Trace.h"
+
+//Rows of border above and below the play area. A reaction reaches two cells
+//away from the particle.
+static const int GUARD_ROWS = 2;
+
+World::World(int width, int height)
+{
+    mWidth = width;
+    mHeight = height;
+    mStride = width + 1;
+
+    //Zeroed (NOTHING) by calloc rather than filled in here: the OS hands
+    //out zero pages on first touch, so the parts of a large world nothing
+    //was ever put into cost no memory
+    mGuard = GUARD_ROWS*mStride;
+    mBuffer = (Cell *)calloc((size_t)mStride*(mHeight+2*GUARD_ROWS), sizeof(Cell));
+    mCells = mBuffer + mGuard;
+
+    //Bit index + mGuard, like the cells
+    mMovedWords = (mStride*(mHeight+2*GUARD_ROWS) + 63) / 64;
+    mMoved = (uint64_t *)calloc(mMovedWords, sizeof(uint64_t));
+
+    mRand.seed = 0;
+    mRandomMode = RANDOM_BANDS;
+    mSeed = 0;
+    mSteps = 0;
+    mMaterials = Materials::Default();
+
+    mBands = (mHeight + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    mBandSeeds.resize(mBands);
+    mBandMovedCells.resize(mBands);
+    mMovedCells = 0;
+    mBandCounts.resize(MAX_MATERIALS*mBands);
+    ResetCounts();
+#ifdef SAND_PROFILE
+    mBandProfiles.resize(mBands);
+#endif
+    ResetProfile();
+
+    mPool = nullptr;
+
+    //Set() turns indices back into coordinates with a multiply and shift,
+    //exact for any index below 2^32
+    mStrideShift = 32;
+    while((1ull << (mStrideShift - 32)) < (unsigned long long)mStride)
+        mStrideShift++;
+    mStrideReciprocal = ((1ull << mStrideShift) + mStride - 1) / mStride;
+
+    mChunksX = (mWidth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    mChunksY = mBands;
+    mChunks = new Chunk[mChunksX*mChunksY];
+    mBandChunks.resize(mChunksX*mChunksY);
+    mBandAwake.resize(mBands);
+    mAwakeChunks = 0;
+
+    //The border: the guard rows and the spare cell right of every row
+    for(int i = 0; i < mGuard; i++)
+    {
+        mBuffer[i] = BORDER;
+        mCells[mStride*mHeight + i] = BORDER;
+    }
+    for(int y = 0; y < mHeight; y++)
+        mCells[mWidth + mStride*y] = BORDER;
+
+    for(int i = mChunksX*mChunksY; i--;)
+    {
+        Chunk &chunk = mChunks[i];
+        chunk.x0 = chunk.y0 = chunk.nx0 = chunk.ny0 = INT_MAX;
+        chunk.x1 = chunk.y1 = chunk.nx1 = chunk.ny1 = INT_MIN;
+        chunk.used = false;
+        chunk.changed = false;
+    }
+}
+
+World::~World()
+{
+    delete[] mChunks;
+    delete mPool;
+    free(mMoved);
+    free(mBuffer);
+}
+
+static inline void AtomicMin(std::atomic<int> &a, int v)
+{
+    int current = a.load(std::memory_order_relaxed);
+    while(v < current && !a.compare_exchange_weak(current, v, std::memory_order_relaxed));
+}
+
+static inline void AtomicMax(std::atomic<int> &a, int v)
+{
+    int current = a.load(std::memory_order_relaxed);
+    while(v > current && !a.compare_exchange_weak(current, v, std::memory_order_relaxed));
+}
+
+// Writing a cell from outside the update (painting, emitters), waking up
+// the chunks around it for the next step.
+inline void World::Set(int index, ParticleType type)
+{
+    mCounts[mCells[index]]--;
+    mCounts[type]++;
+    mCells[index] = (Cell)type;
+    ClearMoved(index, index);
+
+    //The spare rows outside the play area never need waking
+    if(index < 0 || index >= mStride*mHeight)
+        return;
+
+    //index / mStride without the division
+    int y = (int)(((unsigned long long)index * mStrideReciprocal) >> mStrideShift);
+    Wake(index - y*mStride, y);
+}
+
+// Marking (x,y) and its neighbours for update in the next step. A particle
+// only looks at the 8 cells around it, so a change at (x,y) can only make
+// a difference to those.
+inline void World::Wake(int x, int y)
+{
+    WakeRect(x-1, y-1, x+1, y+1);
+}
+
+// Marking the cells from (x0,y0) to (x1,y1) for update in the next step
+void World::WakeRect(int x0, int y0, int x1, int y1)
+{
+    if(x0 < 0) x0 = 0;
+    if(y0 < 0) y0 = 0;
+    if(x1 > mWidth-1) x1 = mWidth-1;
+    if(y1 > mHeight-1) y1 = mHeight-1;
+    if(x0 > x1 || y0 > y1)
+        return;
+
+    //Usually all of it is inside one chunk
+    int cx = x0 / CHUNK_SIZE;
+    int cy = y0 / CHUNK_SIZE;
+    if(x1 / CHUNK_SIZE == cx && y1 / CHUNK_SIZE == cy)
+    {
+        Chunk &chunk = mChunks[cx+(mChunksX*cy)];
+        AtomicMin(chunk.nx0, x0);
+        AtomicMin(chunk.ny0, y0);
+        AtomicMax(chunk.nx1, x1);
+        AtomicMax(chunk.ny1, y1);
+        return;
+    }
+
+    for(cy = y0 / CHUNK_SIZE; cy <= y1 / CHUNK_SIZE; cy++)
+    {
+        for(cx = x0 / CHUNK_SIZE; cx <= x1 / CHUNK_SIZE; cx++)
+        {
+            Chunk &chunk = mChunks[cx+(mChunksX*cy)];
+            AtomicMin(chunk.nx0, x0 > cx*CHUNK_SIZE ? x0 : cx*CHUNK_SIZE);
+            AtomicMin(chunk.ny0, y0 > cy*CHUNK_SIZE ? y0 : cy*CHUNK_SIZE);
+            AtomicMax(chunk.nx1, x1 < (cx+1)*CHUNK_SIZE-1 ? x1 : (cx+1)*CHUNK_SIZE-1);
+            AtomicMax(chunk.ny1, y1 < (cy+1)*CHUNK_SIZE-1 ? y1 : (cy+1)*CHUNK_SIZE-1);
+        }
+    }
+}
+
+// Checks whether the particle at (x,y) may still change on its own in a
+// later step even if nothing around it changes - because it can fall,
+// reacts with a neighbour or just does random things. Such particles keep
+// their chunk awake; everything else is allowed to go to sleep.
+bool World::IsUnsettled(int x, int y, ParticleType type) const
+{
+    int same = x+(mStride*y);
+
+    //Any reaction that could happen? Ignores the odds and whether the
+    //neighbours moved, and looks at both sides for first and second.
+    const int offsets[] = { -mStride, mStride, -1, 1, 1, -1 };
+    const Reaction *end = mMaterials.EndReaction(type);
+    for(const Reaction *rule = mMaterials.FirstReaction(type); rule != end; rule++)
+    {
+        if(rule->pick == PICK_SELF)
+            return true;
+
+        for(int d = 0; d < rule->dirCount; d++)
+        {
+            int dir = rule->dirs[d];
+            if(rule->match[Get(same+offsets[dir])])
+                return true;
+            if((dir == DIR_FIRST || dir == DIR_SECOND) && rule->match[Get(same-offsets[dir])])
+                return true;
+        }
+    }
+
+    if(mMaterials.Has(type, MATERIAL_STATIC))
+        return false;
+
+    //Rising is always up to something
+    if(mMaterials.Has(type, MATERIAL_FLOATS))
+        return true;
+
+    if(implementParticleSwaps && mMaterials.GetSwapChance(type, Get(same-mStride)))
+        return true;
+
+    //Falling particles: anywhere to go?
+    return Get(same+mStride) == NOTHING || Get(same-1) == NOTHING || Get(same+1) == NOTHING ||
+           Get(same+mStride-1) == NOTHING || Get(same+mStride+1) == NOTHING;
+}
+
+void World::Seed(unsigned int seed)
+{
+    mRand.seed = seed;
+    mSeed = seed;
+    mSteps = 0;
+}
+
+void World::SetMaterials(const Materials &materials)
+{
+    mMaterials = materials;
+    ResetProfile();
+
+    //Everything may behave differently now
+    WakeRect(0, 0, mWidth-1, mHeight-1);
+}
+
+void World::SetThreads(int threads)
+{
+    if(threads <= 0)
+        threads = std::thread::hardware_concurrency();
+
+    //No point in more threads than bands of one phase
+    if(threads > (mBands + 1) / 2)
+        threads = (mBands + 1) / 2;
+
+    if(threads == GetThreads())
+        return;
+
+    delete mPool;
+    mPool = threads > 1 ? new WorkerPool(threads) : nullptr;
+}
+
+int World::GetThreads() const
+{
+    return mPool ? mPool->getThreads() : 1;
+}
+
+// The state of one band's update: its own random generator and whether the
+// particle being updated has written anything. The particle logic lives
+// here, so bands running on different threads never share state.
+class World::Updater
+{
+public:
+    Updater(World &world, int band)
+        : mWorld(world), mMaterials(world.mMaterials)
+    {
+        mCells = world.mCells;
+        mMoved = world.mMoved;
+        mGuard = world.mGuard;
+        mStride = world.mStride;
+        implementParticleSwaps = world.implementParticleSwaps;
+        mRand.seed = world.mBandSeeds[band];
+        mCounter = world.mRandomMode == RANDOM_COUNTER;
+        mStepKey = CounterRand::StepKey(world.mSeed, world.mSteps);
+        mWrote = false;
+        mMovedCells = 0;
+        mCounts = &world.mBandCounts[MAX_MATERIALS*band];
+        std::fill(mCounts, mCounts + MAX_MATERIALS, 0);
+#ifdef SAND_PROFILE
+        mProfile = &world.mBandProfiles[band];
+        mVisits = 0;
+#endif
+    }
+
+    void UpdateBand(int band);
+    int GetMovedCells() const { return mMovedCells; }
+
+private:
+    int fastrand() { return mCounter ? mCounterRand() : mRand(); }
+
+    //Next numbers for cell (x,y), with the counter generator
+    void StartCell(int x, int y)
+    {
+        if(mCounter)
+            mCounterRand.Start(mStepKey, x, y);
+    }
+
+    ParticleType Get(int index) const { return (ParticleType)mCells[index]; }
+
+    //Whether the particle at index got there by moving during this step
+    bool Moved(int index) const
+    {
+        unsigned int bit = index + mGuard;
+        return (mMoved[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    //A particle of the given type that has / hasn't moved this step
+    bool HasMoved(int index, ParticleType type) const { return Get(index) == type && Moved(index); }
+    bool IsResting(int index, ParticleType type) const { return Get(index) == type && !Moved(index); }
+
+    void Write(int index, ParticleType type, bool moved)
+    {
+        unsigned int bit = index + mGuard;
+        uint64_t mask = 1ull << (bit & 63);
+        mCounts[mCells[index]]--;
+        mCounts[type]++;
+        mCells[index] = (Cell)type;
+        mMoved[bit >> 6] = moved ? mMoved[bit >> 6] | mask : mMoved[bit >> 6] & ~mask;
+        mWrote = true;
+    }
+
+    //Placing a particle that won't be updated again this step
+    void SetMoved(int index, ParticleType type)
+    {
+        Write(index, type, true);
+        mMovedCells++;
+    }
+    void Set(int index, ParticleType type) { Write(index, type, false); }
+    void Copy(int index, int from) { Write(index, Get(from), Moved(from)); }
+
+    bool React(int x, int y, ParticleType type, int sign);
+    bool Apply(const Reaction &rule, int same, int offset);
+    void MoveParticle(int x, int y, ParticleType type);
+    void UpdateVirtualPixel(int x, int y);
+
+    World &mWorld;
+    const Materials &mMaterials;
+    Cell *mCells;
+    uint64_t *mMoved;
+    int mGuard;
+    int mStride;
+    bool implementParticleSwaps;
+
+    FastRand mRand;
+    bool mCounter;
+    CounterRand mCounterRand;
+    uint64_t mStepKey;
+    bool mWrote;
+    int mMovedCells;
+
+    //The change in the number of cells of every material
+    int *mCounts;
+
+#ifdef SAND_PROFILE
+    //Counting the update of a particle, and timing one in
+    //PROFILE_SAMPLE_INTERVAL of them
+    class Visit
+    {
+    public:
+        Visit(Updater &updater, ParticleType type)
+            : mUpdater(updater), mProfile(updater.mProfile->materials[type])
+        {
+            mProfile.visited++;
+            mSampled = ++updater.mVisits % PROFILE_SAMPLE_INTERVAL == 0;
+            if(mSampled)
+                mStart = std::chrono::steady_clock::now();
+        }
+
+        ~Visit()
+        {
+            if(mUpdater.mWrote)
+                mProfile.moved++;
+            if(mSampled)
+            {
+                mProfile.sampled++;
+                mProfile.sampledSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+            }
+        }
+
+    private:
+        Updater &mUpdater;
+        MaterialProfile &mProfile;
+        bool mSampled;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    Profile *mProfile;
+    unsigned int mVisits;
+#endif
+};
+
+// Emitting a given particletype at (x,o) width pixels wide and
+// with a p density (probability that a given pixel will be drawn
+// at a given position withing the width)
+void World::Emit(int x, int width, ParticleType type, float p)
+{
+    for (int i = x - width/2; i < x + width/2; i++)
+    {
+        if(i < 0 || i >= mWidth)
+            continue;
+
+        int chance;
+        if(mRandomMode == RANDOM_COUNTER)
+        {
+            //Row -1-type, so emitters sharing a column don't share numbers
+            CounterRand rand;
+            rand.Start(CounterRand::StepKey(mSeed, mSteps), i, -1-type);
+            chance = rand();
+        }
+        else
+            chance = mRand();
+
+        if ( chance < (int)(FASTRAND_MAX * p) ) Set(i+mStride, type);
+    }
+}
+
+// Running the reactions of the particle at (x,y), in table order. sign is
+// the side a moving particle looks at first. Returns true when a reaction
+// says the particle is done for this step.
+bool World::Updater::React(int x, int y, ParticleType type, int sign)
+{
+    const int same = x+(mStride*y);
+    const int offsets[] = { -mStride, mStride, -1, 1, sign, -sign };
+
+    const Reaction *end = mMaterials.EndReaction(type);
+    for(const Reaction *rule = mMaterials.FirstReaction(type); rule != end; rule++)
+    {
+        if(rule->chance > 1 && fastrand() % rule->chance != 0)
+            continue;
+
+        switch(rule->pick)
+        {
+            case PICK_SELF:
+                if(Apply(*rule, same, 0) && rule->stop)
+                    return true;
+                break;
+            case PICK_ONE:
+                if(Apply(*rule, same, offsets[rule->dirs[fastrand() % rule->dirCount]]) && rule->stop)
+                    return true;
+                break;
+            default:
+                for(int d = 0; d < rule->dirCount; d++)
+                {
+                    if(Apply(*rule, same, offsets[rule->dirs[d]]))
+                    {
+                        if(rule->stop)
+                            return true;
+                        if(rule->pick == PICK_ANY)
+                            break;
+                    }
+                }
+                break;
+        }
+    }
+    return false;
+}
+
+// Applying a reaction between the particle at same and the neighbour at
+// same+offset, if the neighbour matches. Returns whether it did.
+bool World::Updater::Apply(const Reaction &rule, int same, int offset)
+{
+    int neighbour = same + offset;
+    ParticleType other = Get(neighbour);
+    bool otherMoved = Moved(neighbour);
+
+    if(!(rule.match[other] & (otherMoved ? MATCH_MOVED : MATCH_RESTING)))
+        return false;
+    if(rule.then > 1 && fastrand() % rule.then != 0)
+        return false;
+
+    ParticleType type = Get(same);
+    bool moved = Moved(same);
+
+    unsigned char outcome = rule.other[other];
+    if(outcome == OUTCOME_OTHER)
+        Write(neighbour, type, moved);
+    else if(outcome != OUTCOME_KEEP)
+        Write(neighbour, (ParticleType)(outcome & ~OUTCOME_MOVED), (outcome & OUTCOME_MOVED) != 0);
+
+    //The border stays put, even past a neighbour on the edge
+    outcome = rule.beyond[other];
+    if(outcome != OUTCOME_KEEP && Get(neighbour + offset) != BORDER)
+        Write(neighbour + offset, (ParticleType)(outcome & ~OUTCOME_MOVED), (outcome & OUTCOME_MOVED) != 0);
+
+    outcome = rule.self[other];
+    if(outcome == OUTCOME_OTHER)
+        Write(same, other, otherMoved);
+    else if(outcome != OUTCOME_KEEP)
+        Write(same, (ParticleType)(outcome & ~OUTCOME_MOVED), (outcome & OUTCOME_MOVED) != 0);
+
+#ifdef SAND_PROFILE
+    mProfile->reactions[mMaterials.GetReactionIndex(&rule)]++;
+#endif
+    return true;
+}
+
+// Performing the movement logic of a given particle. The argument 'type'
+// is passed so that we don't need a table lookup when determining the
+// type to set the given particle to
+void World::Updater::MoveParticle(int x, int y, ParticleType type)
+{
+    int above = x+((y-1)*mStride);
+    int same = x+(mStride*y);
+    int below = x+((y+1)*mStride);
+
+
+    //If nothing below then just fall (gravity)
+    if(!mMaterials.Has(type, MATERIAL_FLOATS))
+    {
+        if ( (Get(below) == NOTHING) && (fastrand() % 8)) //fastrand() % 8 makes it spread
+        {
+            SetMoved(below, type);
+            Set(same, NOTHING);
+            return;
+        }
+    }
+    else
+    {
+        if(fastrand()%3 == 0) //Slow down please
+            return;
+
+        //If nothing above then rise (floating - or reverse gravity? ;))
+        if ((Get(above) == NOTHING || IsResting(above, FIRE)) && (fastrand() % 8)) //fastrand() % 8 makes it spread
+        {
+            if (type == FIRE && fastrand()%20 == 0)
+                Set(same, NOTHING);
+            else
+            {
+                Set(above, Get(same));
+                Set(same, NOTHING);
+            }
+            return;
+        }
+
+    }
+
+    //Randomly select right or left first
+    int sign = fastrand() % 2 == 0 ? -1 : 1;
+
+    // We'll only calculate these indicies once for optimization purpose
+    int first = (x+sign)+(mStride*y);
+    int second = (x-sign)+(mStride*y);
+
+    //Particle type specific logic
+    if(React(x, y, type, sign))
+        return;
+
+    //Peform 'realism' logic?
+    if(implementParticleSwaps)
+    {
+        int chance = mMaterials.GetSwapChance(type, Get(above));
+        if(chance && !Moved(above) && (chance == 1 || fastrand() % chance == 0))
+        {
+            Set(same, Get(above));
+            SetMoved(above, type);
+            return;
+        }
+    }
+
+    if(!mMaterials.Has(type, MATERIAL_SPREADS))
+        return;
+
+    // The place below (x,y+1) is filled with something, then check (x+sign,y+1) and (x-sign,y+1)
+    // We chose sign randomly to randomly check eigther left or right
+    // This is for elements that fall downward
+    if (!mMaterials.Has(type, MATERIAL_FLOATS))
+    {
+        int firstdown = (x+sign)+((y+1)*mStride);
+        int seconddown = (x-sign)+((y+1)*mStride);
+
+        if ( Get(firstdown) == NOTHING)
+        {
+            SetMoved(firstdown, type);
+            Set(same, NOTHING);
+        }
+        else if ( Get(seconddown) == NOTHING)
+        {
+            SetMoved(seconddown, type);
+            Set(same, NOTHING);
+        }
+            //If (x+sign,y+1) is filled then try (x+sign,y) and (x-sign,y)
+        else if (Get(first) == NOTHING)
+        {
+            SetMoved(first, type);
+            Set(same, NOTHING);
+        }
+        else if (Get(second) == NOTHING)
+        {
+            SetMoved(second, type);
+            Set(same, NOTHING);
+        }
+    }
+        // Make floating elements (steam) move
+    else
+    {
+        int firstup = (x+sign)+((y-1)*mStride);
+        int secondup = (x-sign)+((y-1)*mStride);
+
+        if ( Get(firstup) == NOTHING)
+        {
+            SetMoved(firstup, type);
+            Set(same, NOTHING);
+        }
+        else if ( Get(secondup) == NOTHING)
+        {
+            SetMoved(secondup, type);
+            Set(same, NOTHING);
+        }
+            //If (x+sign,y+1) is filled then try (x+sign,y) and (x-sign,y)
+        else if (Get(first) == NOTHING)
+        {
+            SetMoved(first, type);
+            Set(same, NOTHING);
+        }
+        else if (Get(second) == NOTHING)
+        {
+            SetMoved(second, type);
+            Set(same, NOTHING);
+        }
+    }
+}
+
+//Drawing a filled circle at a given position with a given radius and a given partice type
+void World::Paint(int xpos, int ypos, int radius, ParticleType type)
+{
+    PaintLine(xpos, ypos, xpos, ypos, radius, type);
+}
+
+// Half widths of the rows of a filled circle: the cells (x,y) with
+// x*x+y*y <= radius*radius are the ones with |x| <= spans[|y|]
+const std::vector<int> &World::CircleSpans(int radius)
+{
+    if(radius >= (int)mCircleSpans.size())
+        mCircleSpans.resize(radius+1);
+
+    std::vector<int> &spans = mCircleSpans[radius];
+    if(spans.empty())
+    {
+        //Squares in 64 bits, the radius goes up to the grid's width+height
+        const long long radius2 = (long long)radius*radius;
+        int half = radius;
+        for(int dy = 0; dy <= radius; dy++)
+        {
+            while((long long)half*half + (long long)dy*dy > radius2)
+                half--;
+            spans.push_back(half);
+        }
+    }
+    return spans;
+}
+
+// Narrowing [lo,hi] to the u with a <= c*u <= b
+static void ClipLinear(double c, double a, double b, double &lo, double &hi)
+{
+    if(c > 0)
+    {
+        lo = std::max(lo, a/c);
+        hi = std::min(hi, b/c);
+    }
+    else if(c < 0)
+    {
+        lo = std::max(lo, b/c);
+        hi = std::min(hi, a/c);
+    }
+    else if(a > 0 || b < 0)
+    {
+        lo = 1;
+        hi = 0;
+    }
+}
+
+// Drawing a line: every cell within radius of the segment from (oldx,oldy)
+// to (newx,newy), each written once. A row of the stroke is the union of
+// the circles around both ends and the band swept between them, and as the
+// stroke is convex that is a single span.
+void World::PaintLine(int newx, int newy, int oldx, int oldy, int radius, ParticleType type)
+{
+    if(radius < 0)
+        return;
+
+    //From anywhere in the grid a brush this big already reaches every cell
+    //(the diagonal is shorter), anything more only costs a bigger span table
+    radius = std::min(radius, mWidth + mHeight);
+
+    const std::vector<int> &spans = CircleSpans(radius);
+
+    double dx = newx - oldx;
+    double dy = newy - oldy;
+    double length2 = dx*dx + dy*dy;
+
+    //Half the thickness of the band. One pixel lines still get a cell in
+    //every row and column they cross.
+    double reach = (radius > 0 ? radius : 0.5) * sqrt(length2);
+
+    int top = std::max(std::min(newy, oldy) - radius, 0);
+    int bottom = std::min(std::max(newy, oldy) + radius, mHeight-1);
+
+    for(int y = top; y <= bottom; y++)
+    {
+        int x0 = INT_MAX;
+        int x1 = INT_MIN;
+
+        if(abs(y-oldy) <= radius)
+        {
+            x0 = oldx - spans[abs(y-oldy)];
+            x1 = oldx + spans[abs(y-oldy)];
+        }
+        if(abs(y-newy) <= radius)
+        {
+            x0 = std::min(x0, newx - spans[abs(y-newy)]);
+            x1 = std::max(x1, newx + spans[abs(y-newy)]);
+        }
+
+        if(length2 > 0)
+        {
+            //u = x-oldx projects onto the segment and lies within reach of it
+            double ry = y - oldy;
+            double lo = -1e300;
+            double hi = 1e300;
+            ClipLinear(dx, -ry*dy, length2 - ry*dy, lo, hi);
+            ClipLinear(dy, ry*dx - reach, ry*dx + reach, lo, hi);
+            if(lo <= hi)
+            {
+                x0 = std::min(x0, oldx + (int)ceil(lo - 1e-9));
+                x1 = std::max(x1, oldx + (int)floor(hi + 1e-9));
+            }
+        }
+
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, mWidth-1);
+        if(x0 <= x1)
+            SetSpan(x0, x1, y, type);
+    }
+}
+
+// Filling the cells from (x0,y) to (x1,y) with the same type
+void World::SetSpan(int x0, int x1, int y, ParticleType type)
+{
+    int first = x0 + mStride*y;
+    int last = x1 + mStride*y;
+    for(int i = first; i <= last; i++)
+    {
+        mCounts[mCells[i]]--;
+        mCells[i] = (Cell)type;
+    }
+    mCounts[type] += x1 - x0 + 1;
+
+    ClearMoved(first, last);
+    WakeRect(x0-1, y-1, x1+1, y+1);
+}
+
+// Updating a virtual pixel
+inline void World::Updater::UpdateVirtualPixel(int x, int y)
+{
+    ParticleType same = Get(x+(mStride*y));
+    if(same != NOTHING)
+    {
+        mWrote = false;
+        StartCell(x, y);
+#ifdef SAND_PROFILE
+        Visit visit(*this, same);
+#endif
+
+        if(mMaterials.Has(same, MATERIAL_STATIC))
+            React(x,y,same,0);
+        else if(Moved(x+(mStride*y)))
+            return; //Moved here this step, its writes already woke the surroundings
+        else
+        if ( fastrand() >= FASTRAND_MAX / 13) MoveParticle(x,y,same); //THe rand condition makes the particles fall unevenly
+
+        //A particle writes at most one cell sideways, two up and one down.
+        //Wake those and their neighbours - or just this one if it is not
+        //done yet.
+        if(mWrote)
+            mWorld.WakeRect(x-2, y-3, x+2, y+2);
+        else if(mWorld.IsUnsettled(x,y,same))
+            mWorld.Wake(x,y);
+    }
+
+}
+
+// Updating the awake parts of one band of scanlines, top to bottom
+void World::Updater::UpdateBand(int band)
+{
+    const int mChunksX = mWorld.mChunksX;
+    const int mHeight = mWorld.mHeight;
+    const Chunk *row = &mWorld.mChunks[mChunksX*band];
+
+    int end = (band + 1) * BAND_HEIGHT;
+    if(end > mHeight)
+        end = mHeight;
+
+    //Only the awake chunks of the band (listed by Step()) and the rows they
+    //span, so the cost of a band follows what is going on in it rather
+    //than its width
+    const int *awake = &mWorld.mBandChunks[mChunksX*band];
+    int count = mWorld.mBandAwake[band];
+    if(count == 0)
+        return;
+
+    int top = INT_MAX;
+    int bottom = INT_MIN;
+    for(int i = 0; i < count; i++)
+    {
+        const Chunk &chunk = row[awake[i]];
+        if(chunk.y0 < top)
+            top = chunk.y0;
+        if(chunk.y1 > bottom)
+            bottom = chunk.y1;
+    }
+
+    for(int y = band * BAND_HEIGHT; y < end; y++)
+    {
+        const Cell *cells = mCells + mStride*y;
+
+        // Due to biasing when iterating through the scanline from left to right,
+        // we now chose our direction randomly per scanline.
+        StartCell(-1, y);
+        bool backward = fastrand() % 2 == 0;
+
+        //Drawn even for the rows skipped, so the rows after them get the
+        //same numbers either way
+        if(y < top || y > bottom)
+            continue;
+
+        if (backward)
+        {
+            for(int i = count; i--;)
+            {
+                const Chunk &chunk = row[awake[i]];
+                if(y < chunk.y0 || y > chunk.y1)
+                    continue;
+                int x0 = chunk.x0;
+                int x1 = chunk.x1;
+                for(int x = x1; x >= x0; x--)
+                {
+                    //Skip the empty stretches in one go
+                    if(cells[x] == NOTHING && (x = FindOccupiedBackward(cells, x, x0)) < x0)
+                        break;
+                    UpdateVirtualPixel(x,y);
+                }
+            }
+        }
+        else
+        {
+            for(int i = 0; i < count; i++)
+            {
+                const Chunk &chunk = row[awake[i]];
+                if(y < chunk.y0 || y > chunk.y1)
+                    continue;
+                int x0 = chunk.x0;
+                int x1 = chunk.x1;
+                for(int x = x0; x <= x1; x++)
+                {
+                    if(cells[x] == NOTHING && (x = FindOccupied(cells, x, x1)) > x1)
+                        break;
+                    UpdateVirtualPixel(x,y);
+                }
+            }
+        }
+    }
+}
+
+void World::UpdateBand(int band)
+{
+    //Nothing to update, and nothing to show in a trace
+    if(mBandAwake[band] == 0)
+    {
+        mBandMovedCells[band] = 0;
+        return;
+    }
+
+    TraceZone zone("band", "band", band);
+    Updater updater(*this, band);
+    updater.UpdateBand(band);
+    mBandMovedCells[band] = updater.GetMovedCells();
+}
+
+// Clearing the moved bits of cells first..last
+void World::ClearMoved(int first, int last)
+{
+    unsigned int from = first + mGuard;
+    unsigned int to = last + mGuard;
+    uint64_t head = ~0ull << (from & 63);
+    uint64_t tail = ~0ull >> (63 - (to & 63));
+
+    if(from >> 6 == to >> 6)
+    {
+        mMoved[from >> 6] &= ~(head & tail);
+        return;
+    }
+
+    mMoved[from >> 6] &= ~head;
+    for(unsigned int i = (from >> 6) + 1; i < to >> 6; i++)
+        mMoved[i] = 0;
+    mMoved[to >> 6] &= ~tail;
+}
+
+// Running work(band) for bands first, first+step, ... on the worker pool
+void World::RunBands(int first, int step, void (World::*work)(int))
+{
+    int count = (mBands - first + step - 1) / step;
+
+    if(mPool)
+        mPool->Run(count, [this, first, step, work](int i) { (this->*work)(first + i*step); });
+    else
+        for(int i = 0; i < count; i++)
+            (this->*work)(first + i*step);
+}
+
+// Updating the particle system (virtual screen) band by band
+void World::Step()
+{
+    TraceZone zone("step");
+
+    //Clear bottom line
+    for (int i=0; i< mWidth; i++) if(Get(i+((mHeight-1)*mStride)) != NOTHING) Set(i+((mHeight-1)*mStride), NOTHING);
+    //Clear top line
+    for (int i=0; i< mWidth; i++) if(Get(i+((0)*mStride)) != NOTHING) Set(i+((0)*mStride), NOTHING);
+
+    //What was woken last step gets updated in this one. Particles only
+    //moved where cells were written, and all of those were woken, so
+    //clearing the moved bits there starts everything off unmoved.
+    //Every chunk is looked at, so on a large world this has to stay cheap:
+    //sleeping chunks cost two relaxed loads, and the awake ones are listed
+    //per band for UpdateBand().
+    mAwakeChunks = 0;
+    for(int band = 0; band < mBands; band++)
+    {
+        Chunk *row = &mChunks[mChunksX*band];
+        int *awake = &mBandChunks[mChunksX*band];
+        int count = 0;
+
+        for(int cx = 0; cx < mChunksX; cx++)
+        {
+            Chunk &chunk = row[cx];
+            int nx0 = chunk.nx0.load(std::memory_order_relaxed);
+            int nx1 = chunk.nx1.load(std::memory_order_relaxed);
+            if(nx0 > nx1)
+            {
+                chunk.x0 = chunk.y0 = INT_MAX;
+                chunk.x1 = chunk.y1 = INT_MIN;
+                continue;
+            }
+
+            chunk.x0 = nx0; chunk.y0 = chunk.ny0.load(std::memory_order_relaxed);
+            chunk.x1 = nx1; chunk.y1 = chunk.ny1.load(std::memory_order_relaxed);
+            chunk.nx0.store(INT_MAX, std::memory_order_relaxed);
+            chunk.ny0.store(INT_MAX, std::memory_order_relaxed);
+            chunk.nx1.store(INT_MIN, std::memory_order_relaxed);
+            chunk.ny1.store(INT_MIN, std::memory_order_relaxed);
+            chunk.used = true;
+            chunk.changed = true;
+            awake[count++] = cx;
+
+            for(int y = chunk.y0; y <= chunk.y1; y++)
+                ClearMoved(chunk.x0+(mStride*y), chunk.x1+(mStride*y));
+        }
+
+        mBandAwake[band] = count;
+        mAwakeChunks += count;
+    }
+
+    //Seed every band up front, so the outcome doesn't depend on which
+    //thread picks up which band
+    if(mRandomMode == RANDOM_BANDS)
+    {
+        for(int b = 0; b < mBands; b++)
+        {
+            unsigned int high = mRand();
+            mBandSeeds[b] = (high << 16) ^ mRand();
+        }
+    }
+
+    //Even bands, then odd bands. Neighbouring bands never run together.
+    RunBands(0, 2, &World::UpdateBand);
+    RunBands(1, 2, &World::UpdateBand);
+
+    //Bands without awake chunks wrote nothing
+    mMovedCells = 0;
+    for(int band = 0; band < mBands; band++)
+    {
+        mMovedCells += mBandMovedCells[band];
+        if(mBandAwake[band] > 0)
+        {
+            const int *counts = &mBandCounts[MAX_MATERIALS*band];
+            for(int t = 0; t < MAX_MATERIALS; t++)
+                mCounts[t] += counts[t];
+#ifdef SAND_PROFILE
+            mProfile.Add(mBandProfiles[band]);
+            mBandProfiles[band].Clear(mMaterials.GetReactionCount());
+#endif
+        }
+    }
+
+    mSteps++;
+}
+
+uint64_t World::GetHash() const
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(int y = 0; y < mHeight; y++)
+    {
+        const Cell *row = mCells + mStride*y;
+        for(int x = 0; x < mWidth; x++)
+        {
+            hash ^= (uint64_t)row[x];
+            hash *= 0x100000001B3ull;
+        }
+    }
+    return hash;
+}
+
+//Cearing the particle system
+void World::Clear()
+{
+    for(int i = mChunksX*mChunksY; i--;)
+    {
+        Chunk &chunk = mChunks[i];
+
+        //Every cell ever written woke its chunk, so only those that were
+        //awake (or are about to be) can hold anything
+        if(chunk.used || chunk.nx0 <= chunk.nx1)
+        {
+            int x0 = (i % mChunksX) * CHUNK_SIZE;
+            int y0 = (i / mChunksX) * CHUNK_SIZE;
+            int x1 = x0 + CHUNK_SIZE < mWidth ? x0 + CHUNK_SIZE : mWidth;
+            int y1 = y0 + CHUNK_SIZE < mHeight ? y0 + CHUNK_SIZE : mHeight;
+            for(int y = y0; y < y1; y++)
+            {
+                for(int x = x0; x < x1; x++)
+                    mCells[x+(mStride*y)] = NOTHING;
+                ClearMoved(x0+(mStride*y), x1-1+(mStride*y));
+            }
+            chunk.changed = true;
+        }
+
+        //Nothing left to update
+        chunk.x0 = chunk.y0 = chunk.nx0 = chunk.ny0 = INT_MAX;
+        chunk.x1 = chunk.y1 = chunk.nx1 = chunk.ny1 = INT_MIN;
+        chunk.used = false;
+    }
+
+    ResetCounts();
+}
+
+bool World::TakeChanged(int cx, int cy)
+{
+    Chunk &chunk = mChunks[cx + mChunksX*cy];
+
+    //Woken since the last step, or by a step since the last call
+    bool changed = chunk.changed || chunk.nx0.load(std::memory_order_relaxed) <= chunk.nx1.load(std::memory_order_relaxed);
+    chunk.changed = false;
+    return changed;
+}
+
+// Starting the profile over, for the reactions of the current table
+void World::ResetProfile()
+{
+    mProfile.Clear(mMaterials.GetReactionCount());
+#ifdef SAND_PROFILE
+    for(Profile &profile : mBandProfiles)
+        profile.Clear(mMaterials.GetReactionCount());
+#endif
+}
+
+// Counting every cell as empty
+void World::ResetCounts()
+{
+    std::fill(mCounts, mCounts + MAX_MATERIALS, 0);
+    mCounts[NOTHING] = mWidth*mHeight;
+}
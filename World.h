@@ -0,0 +1,363 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SDLSAND_WORLD_H
+#define SDLSAND_WORLD_H
+
+// The particle simulation core. Nothing in here depends on SDL, so it can be
+// linked into headless tools (benchmarks, profiling runs, servers) as well as
+// into the game itself.
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Materials.h"
+#include "Profile.h"
+
+class WorkerPool;
+
+#define FASTRAND_MAX 32767
+
+//The grid is split into CHUNK_SIZE x CHUNK_SIZE chunks. A chunk is only
+//updated where something changed last step or where a particle may still
+//act on its own; settled chunks sleep.
+const int CHUNK_SIZE = 32;
+
+//Rows per band of the parallel update - one row of chunks. Bands are updated
+//in two phases (even bands, then odd bands); a particle only touches rows
+//y-2..y+1, so bands running at the same time never share a row.
+const int BAND_HEIGHT = CHUNK_SIZE;
+
+//Fast linear congruential generator. Every band of the update gets its own,
+//so workers never share random state.
+struct FastRand
+{
+    unsigned int seed;
+
+    int operator()()
+    {
+        seed = (214013*seed+2531011);
+        return (seed>>16)&0x7FFF;
+    }
+};
+
+//Stateless generator: the numbers a cell draws in a step only depend on
+//(seed, step, x, y) and how many it drew before - not on which cells were
+//updated before it, in which order or on which thread.
+struct CounterRand
+{
+    uint64_t key;
+    unsigned int draw;
+
+    //SplitMix64 finalizer
+    static uint64_t Mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    static uint64_t StepKey(unsigned int seed, unsigned int step)
+    {
+        return Mix(Mix(seed) ^ step);
+    }
+
+    //Starting on the numbers of cell (x,y)
+    void Start(uint64_t stepKey, int x, int y)
+    {
+        key = Mix(stepKey ^ (((uint64_t)(uint32_t)y << 32) | (uint32_t)x));
+        draw = 0;
+    }
+
+    //0..FASTRAND_MAX, like FastRand
+    int operator()()
+    {
+        return (int)(Mix(key + (uint64_t)(draw++) * 0x9E3779B97F4A7C15ull) >> 49);
+    }
+};
+
+//Where the random numbers of a step come from
+enum RandomMode
+{
+    RANDOM_BANDS,   //a FastRand per band, seeded one after another (default)
+    RANDOM_COUNTER  //a CounterRand for every cell
+};
+
+//The built-in materials, ids as in materials.txt. A different table may add
+//more materials, they just have no name in here.
+enum ParticleType
+{
+    // STILLBORN
+    NOTHING = 0,
+    WALL = 1,
+    IRONWALL = 2,
+    TORCH = 3,
+    //x = 4,
+    STOVE = 5,
+    ICE = 6,
+    RUST = 7,
+    EMBER = 8,
+    PLANT = 9,
+    VOID = 10,
+
+    //SPOUTS
+    WATERSPOUT = 11,
+    SANDSPOUT = 12,
+    SALTSPOUT = 13,
+    OILSPOUT = 14,
+    //x = 15,
+
+    //ELEMENTAL
+    WATER = 16,
+    DIRT = 17,
+    SALT = 18,
+    OIL = 19,
+    SAND = 20,
+
+    //COMBINED
+    SALTWATER = 21,
+    MUD = 22,
+    ACID = 23,
+
+    //FLOATING
+    STEAM = 24,
+    FIRE = 25,
+
+    //ELECTRICITY
+    ELEC = 26,
+
+    //Fills the ring of cells around the play area (MATERIAL_BORDER)
+    BORDER = 63
+};
+
+//One cell of the grid. Every particle type fits in a byte, and a quarter of
+//the memory traffic of the enum makes a big difference on large grids.
+//Define SAND_WIDE_CELLS to get the old 4 byte cells back, for comparison.
+#ifdef SAND_WIDE_CELLS
+typedef uint32_t Cell;
+#else
+typedef uint8_t Cell;
+#endif
+
+// The particle system play area. Cells are addressed as x+(width*y), with
+// (0,0) in the top left corner.
+class World
+{
+public:
+    //Allocates an empty width x height world
+    World(int width, int height);
+    ~World();
+
+    //Seeds the random generator driving the simulation and starts
+    //counting steps from 0
+    void Seed(unsigned int seed);
+    unsigned int GetSeed() const { return mSeed; }
+
+    //Switches between the random generators. With RANDOM_COUNTER the
+    //numbers a cell draws don't depend on the order the bands and cells
+    //are updated in, only on the seed, the step and the cell.
+    void SetRandomMode(RandomMode mode) { mRandomMode = mode; }
+    RandomMode GetRandomMode() const { return mRandomMode; }
+
+    //The materials and reactions the simulation runs on (the built-in
+    //table unless told otherwise)
+    void SetMaterials(const Materials &materials);
+    const Materials &GetMaterials() const { return mMaterials; }
+
+    //Sets the number of threads Step() runs on (0 = one per CPU core).
+    //The result of a step does not depend on the thread count.
+    void SetThreads(int threads);
+    int GetThreads() const;
+
+    //Advances the simulation by one step
+    void Step();
+
+    //Clears the particle system
+    void Clear();
+
+    //Emitting a given particle type at (x,0) width pixels wide and
+    //with a p density (probability that a given pixel will be drawn
+    //at a given position within the width)
+    void Emit(int x, int width, ParticleType type, float p);
+
+    //Drawing a filled circle at a given position with a given radius
+    void Paint(int xpos, int ypos, int radius, ParticleType type);
+
+    //Drawing a line radius cells thick from (oldx,oldy) to (newx,newy),
+    //with round ends. Every covered cell is written once.
+    void PaintLine(int newx, int newy, int oldx, int oldy, int radius, ParticleType type);
+
+    //Number of chunks updated by the last step
+    int GetAwakeChunks() const { return mAwakeChunks; }
+
+    //The grid in chunks of CHUNK_SIZE x CHUNK_SIZE cells
+    int GetChunksX() const { return mChunksX; }
+    int GetChunksY() const { return mChunksY; }
+
+    //Whether cells of chunk (cx,cy) may have changed since the last call
+    //for it. Every write wakes its chunk, so this errs on the side of
+    //changed: an awake chunk counts even if nothing in it moved.
+    bool TakeChanged(int cx, int cy);
+
+    //Number of cells a particle moved (or was spawned) into by the last step
+    int GetMovedCells() const { return mMovedCells; }
+
+    //Number of cells holding the given material (for NOTHING: the empty
+    //ones). Kept up to date by every write to the grid, so reading it is
+    //free.
+    int GetCount(ParticleType type) const { return mCounts[type]; }
+
+    //Number of cells holding a particle of any kind
+    int GetParticleCount() const { return mWidth*mHeight - mCounts[NOTHING]; }
+
+    //What the steps since the last SetMaterials() spent their time on.
+    //Only collected when built with SAND_PROFILE, empty otherwise.
+    const Profile &GetProfile() const { return mProfile; }
+
+    //Reading the grid
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+    ParticleType GetCell(int x, int y) const { return Get(x+(mStride*y)); }
+
+    //Row y starts at GetCells() + GetStride()*y. The cells right of a row
+    //and above and below the grid are BORDER.
+    const Cell *GetCells() const { return mCells; }
+    int GetStride() const { return mStride; }
+
+    //64 bit FNV-1a hash of the particle types in the grid, for checking
+    //that two runs ended up in the same state
+    uint64_t GetHash() const;
+
+    //Swap lighter particles up through heavier ones (water under sand etc.)
+    bool implementParticleSwaps = true;
+
+private:
+    World(const World &);
+    World &operator=(const World &);
+
+    struct Chunk
+    {
+        //Cells updated this step (inclusive), empty when x0 > x1
+        int x0, y0, x1, y1;
+
+        //Cells woken during this step, updated next step. Atomic because
+        //a band may wake cells of the chunk rows above and below it.
+        std::atomic<int> nx0, ny0, nx1, ny1;
+
+        //Awake at some point since the last Clear(), so it may hold
+        //particles. Untouched chunks are never even read by Clear().
+        bool used;
+
+        //Woken or cleared since the last TakeChanged()
+        bool changed;
+    };
+
+    //The particle logic, one instance per band being updated
+    class Updater;
+    friend class Updater;
+
+    ParticleType Get(int index) const { return (ParticleType)mCells[index]; }
+    void Set(int index, ParticleType type);
+    void SetSpan(int x0, int x1, int y, ParticleType type);
+    void ResetCounts();
+    void ResetProfile();
+    void ClearMoved(int first, int last);
+    void Wake(int x, int y);
+    void WakeRect(int x0, int y0, int x1, int y1);
+    bool IsUnsettled(int x, int y, ParticleType type) const;
+    const std::vector<int> &CircleSpans(int radius);
+
+    void UpdateBand(int band);
+    void RunBands(int first, int step, void (World::*work)(int));
+
+    int mWidth;
+    int mHeight;
+
+    //Distance between rows: the width plus one BORDER cell, which is both
+    //the right neighbour of the last cell of a row and the left one of the
+    //first cell of the next
+    int mStride;
+    unsigned long long mStrideReciprocal;
+    int mStrideShift;
+
+    //Backing store with two rows of BORDER above and below the play area.
+    //Every neighbour of a cell in the play area is inside the allocation,
+    //and the border never moves or reacts, so the update needs no bounds
+    //checks.
+    Cell *mBuffer;
+
+    // Instead of using a two-dimensional array
+    // we'll use a simple array to improve speed
+    Cell *mCells;
+
+    //One bit per cell (same indices as mBuffer), set where a particle moved
+    //to during the current step so it isn't updated twice. Cleared for the
+    //awake chunks at the start of every step.
+    uint64_t *mMoved;
+    int mMovedWords;
+
+    //Cells in the border rows above the play area
+    int mGuard;
+
+    Materials mMaterials;
+
+    //Generator for everything outside the banded update (emitters, band seeds)
+    FastRand mRand;
+
+    RandomMode mRandomMode;
+    unsigned int mSeed;
+    unsigned int mSteps;
+
+    int mBands;
+    std::vector<unsigned int> mBandSeeds;
+    std::vector<int> mBandMovedCells;
+    int mMovedCells;
+
+    //Cells per material id. A band counts what it changes in its own slice
+    //of mBandCounts (MAX_MATERIALS per band), added up after the step.
+    int mCounts[MAX_MATERIALS];
+    std::vector<int> mBandCounts;
+
+    //Like the counts: a profile per band, added up after the step
+    Profile mProfile;
+#ifdef SAND_PROFILE
+    std::vector<Profile> mBandProfiles;
+#endif
+
+    //Only created when running on more than one thread
+    WorkerPool *mPool;
+
+    int mChunksX;
+    int mChunksY;
+    Chunk *mChunks;
+
+    //The awake chunks of every band this step: mBandAwake[b] chunk columns
+    //from mBandChunks[mChunksX*b] on
+    std::vector<int> mBandChunks;
+    std::vector<int> mBandAwake;
+    int mAwakeChunks;
+
+    //Row half widths of the brush circles, by radius (see CircleSpans)
+    std::vector<std::vector<int> > mCircleSpans;
+};
+
+#endif //SDLSAND_WORLD_H
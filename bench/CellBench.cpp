@@ -0,0 +1,151 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Measures what the cell layout costs: steps a busy 2048x2048 world and
+// scans the grid the way DrawScene does, counting cache misses where the
+// kernel allows it. Built twice - cellbench with 1 byte cells and
+// cellbench_wide with the old 4 byte ones - so the two can be compared:
+//
+//   cellbench -size 2048 -steps 100 -threads 1
+//   cellbench_wide -size 2048 -steps 100 -threads 1
+//
+// Prints one JSON object per run.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "CmdLine.h"
+#include "World.h"
+#include "bench/PerfCounter.h"
+
+static double Seconds(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+//Shelves of wall with everything loose piled in between, and the game's
+//emitters on top, so most of the grid is awake for the whole run
+static void BuildScene(World &world)
+{
+    static const ParticleType loose[] = { WATER, SAND, SALT, OIL, DIRT, SALTWATER };
+    const int width = world.GetWidth();
+    const int height = world.GetHeight();
+
+    FastRand rand;
+    rand.seed = 1;
+
+    for(int y = height/8; y < height - 2; y++)
+    {
+        for(int x = 1; x < width - 1; x++)
+        {
+            if(rand() % 2 == 0)
+                world.Paint(x, y, 0, loose[rand() % 6]);
+        }
+    }
+
+    for(int y = height/4; y < height; y += height/4)
+        world.PaintLine(width/8, y, width - width/8, y, 1, WALL);
+}
+
+int main(int argc, char **argv)
+{
+    CCmdLine cmdLine;
+    cmdLine.SplitLine(argc, argv);
+
+    int size = atoi(cmdLine.GetSafeArgument("-size", 0, "2048").c_str());
+    int steps = atoi(cmdLine.GetSafeArgument("-steps", 0, "100").c_str());
+    int scans = atoi(cmdLine.GetSafeArgument("-scans", 0, "100").c_str());
+    int threads = atoi(cmdLine.GetSafeArgument("-threads", 0, "1").c_str());
+
+    if (size < 64 || steps < 1 || scans < 1)
+    {
+        fprintf(stderr, "Invalid size, step or scan count\n");
+        return 1;
+    }
+
+    const double cells = (double)size * size;
+    PerfCounter stepMisses(PerfCounter::CACHE_MISSES);
+    PerfCounter scanMisses(PerfCounter::CACHE_MISSES);
+    double stepSeconds, scanSeconds;
+    int awake;
+    long long particles = 0;
+
+    {
+        World world(size, size);
+        world.Seed(1);
+        world.SetThreads(threads);
+        threads = world.GetThreads();
+        BuildScene(world);
+
+        //Reading every cell once per frame, like DrawScene
+        scanMisses.Start();
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < scans; i++)
+        {
+            const Cell *vs = world.GetCells();
+            const Materials &materials = world.GetMaterials();
+            int particleCount = 0;
+            for(int y = size; y--;)
+            {
+                const Cell *row = vs + world.GetStride()*y;
+                for(int x = size; x--;)
+                {
+                    ParticleType same = (ParticleType)row[x];
+                    if(same != NOTHING && !materials.Has(same, MATERIAL_STATIC))
+                        particleCount++;
+                }
+            }
+            particles += particleCount;
+        }
+        scanSeconds = Seconds(start);
+        scanMisses.Stop();
+
+        stepMisses.Start();
+        start = std::chrono::steady_clock::now();
+        for(int i = 0; i < steps; i++)
+        {
+            world.Emit(size/2 - (size/6)*2, size/8, WATER, 0.3f);
+            world.Emit(size/2 - size/6, size/8, SAND, 0.3f);
+            world.Emit(size/2 + size/6, size/8, SALT, 0.3f);
+            world.Emit(size/2 + (size/6)*2, size/8, OIL, 0.3f);
+            world.Step();
+        }
+        stepSeconds = Seconds(start);
+        awake = world.GetAwakeChunks();
+    }
+    //Worker threads are gone now, so their misses are in the count too
+    stepMisses.Stop();
+
+    printf("{\"cell_bytes\": %d, \"width\": %d, \"height\": %d, \"threads\": %d, "
+           "\"steps\": %d, \"steps_per_sec\": %.2f, \"step_ns_per_cell\": %.3f, "
+           "\"step_cache_misses_per_cell\": %.4f, \"awake_chunks\": %d, "
+           "\"scans\": %d, \"scan_ns_per_cell\": %.3f, \"scan_cache_misses_per_cell\": %.4f, "
+           "\"particles\": %lld}\n",
+           (int)sizeof(Cell), size, size, threads,
+           steps, steps / stepSeconds, stepSeconds * 1e9 / (steps * cells),
+           stepMisses.IsAvailable() ? stepMisses.Read() / (steps * cells) : -1.0, awake,
+           scans, scanSeconds * 1e9 / (scans * cells),
+           scanMisses.IsAvailable() ? scanMisses.Read() / (scans * cells) : -1.0,
+           particles / scans);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SDLSAND_PERFCOUNTER_H
+#define SDLSAND_PERFCOUNTER_H
+
+// A hardware event counter (cache misses, instructions, ...) for the
+// benchmarks. Uses perf_event_open on Linux and reads -1 everywhere else or
+// when the kernel doesn't let us count (containers, perf_event_paranoid).
+//
+// The counter follows threads created after it was opened, but their counts
+// only show up once they have exited - so open it before the World and read
+// it after the World (and its worker threads) are gone.
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class PerfCounter
+{
+public:
+    enum Event
+    {
+        CACHE_MISSES,
+        INSTRUCTIONS,
+        CYCLES
+    };
+
+    explicit PerfCounter(Event event)
+    {
+        mFd = -1;
+#ifdef __linux__
+        static const unsigned long long configs[] = {
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CPU_CYCLES
+        };
+
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[event];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        mFd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~PerfCounter()
+    {
+#ifdef __linux__
+        if(mFd >= 0)
+            close(mFd);
+#endif
+    }
+
+    bool IsAvailable() const { return mFd >= 0; }
+
+    //Zeroes the counter and starts counting
+    void Start()
+    {
+#ifdef __linux__
+        if(mFd >= 0)
+        {
+            ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void Stop()
+    {
+#ifdef __linux__
+        if(mFd >= 0)
+            ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    //Events counted so far, -1 if unavailable
+    long long Read() const
+    {
+#ifdef __linux__
+        long long count;
+        if(mFd >= 0 && read(mFd, &count, sizeof(count)) == sizeof(count))
+            return count;
+#endif
+        return -1;
+    }
+
+private:
+    PerfCounter(const PerfCounter &);
+    PerfCounter &operator=(const PerfCounter &);
+
+    int mFd;
+};
+
+#endif //SDLSAND_PERFCOUNTER_H
@@ -0,0 +1,149 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+// Times the cell to pixel converters DrawScene picks from (PixelConvert.h)
+// against each other, converting a whole frame at a time:
+//
+//   pixelbench -sizes 300x170,1920x1080,4096x4096 -seconds 0.5
+//
+// Prints one JSON object per size and converter, with its speed relative to
+// the scalar one and whether it drew the same pixels.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CmdLine.h"
+#include "PixelConvert.h"
+#include "World.h"
+
+static double Seconds(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+//Empty sky over loose particles of every kind, shelves of wall and the
+//border, like a busy frame of the game
+static void BuildFrame(std::vector<Cell> &cells, int width, int height)
+{
+    static const ParticleType loose[] = { WATER, SAND, SALT, OIL, DIRT, SALTWATER, STEAM, FIRE, ACID, MUD };
+
+    FastRand rand;
+    rand.seed = 1;
+
+    cells.assign((size_t)width * height, NOTHING);
+    for(int y = height/4; y < height; y++)
+        for(int x = 0; x < width; x++)
+            if(rand() % 2 == 0)
+                cells[(size_t)width*y + x] = loose[rand() % 10];
+
+    for(int y = height/4; y < height; y += height/4 + 1)
+        for(int x = width/8; x < width - width/8; x++)
+            cells[(size_t)width*y + x] = WALL;
+
+    for(int x = 0; x < width; x++)
+        cells[(size_t)width*(height-1) + x] = BORDER;
+}
+
+//Converts the frame until seconds have passed, returns the seconds per frame
+static double Time(CellConverter convert, const std::vector<Cell> &cells, int width, int height,
+                   const uint32_t *palette, std::vector<uint32_t> &pixels, double seconds)
+{
+    int frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed;
+    do
+    {
+        convert(cells.data(), width, width, height, palette, pixels.data(), width*4);
+        frames++;
+        elapsed = Seconds(start);
+    }
+    while(elapsed < seconds);
+    return elapsed / frames;
+}
+
+int main(int argc, char **argv)
+{
+    CCmdLine cmdLine;
+    cmdLine.SplitLine(argc, argv);
+
+    double seconds = atof(cmdLine.GetSafeArgument("-seconds", 0, "0.5").c_str());
+
+    std::vector<std::pair<int, int> > sizes;
+    std::istringstream list(cmdLine.GetSafeArgument("-sizes", 0, "300x170,1920x1080,4096x4096"));
+    std::string item;
+    while(std::getline(list, item, ','))
+    {
+        int width = 0, height = 0;
+        if(sscanf(item.c_str(), "%dx%d", &width, &height) != 2 || width < 1 || height < 1)
+        {
+            fprintf(stderr, "Invalid size %s, sizes are WIDTHxHEIGHT\n", item.c_str());
+            return 1;
+        }
+        sizes.push_back(std::make_pair(width, height));
+    }
+
+    //Opaque colors, different in every byte
+    uint32_t palette[MAX_MATERIALS];
+    for(int t = 0; t < MAX_MATERIALS; t++)
+        palette[t] = 0xFF000000u | (uint32_t)(CounterRand::Mix(t) & 0xFFFFFF);
+
+    std::vector<CellConverterKind> converters = GetCellConverters();
+
+    for(const std::pair<int, int> &size : sizes)
+    {
+        const int width = size.first;
+        const int height = size.second;
+
+        std::vector<Cell> cells;
+        BuildFrame(cells, width, height);
+
+        std::vector<uint32_t> expected((size_t)width * height);
+        std::vector<uint32_t> pixels((size_t)width * height);
+        converters[0].convert(cells.data(), width, width, height, palette, expected.data(), width*4);
+
+        double scalarSeconds = 0;
+        for(const CellConverterKind &converter : converters)
+        {
+            memset(pixels.data(), 0, pixels.size() * sizeof(uint32_t));
+            double frameSeconds = Time(converter.convert, cells, width, height, palette, pixels, seconds);
+            bool same = pixels == expected;
+            if(scalarSeconds == 0)
+                scalarSeconds = frameSeconds;
+
+            printf("{\"width\": %d, \"height\": %d, \"converter\": \"%s\", \"best\": %s, \"ms_per_frame\": %.4f, "
+                   "\"ns_per_pixel\": %.4f, \"speedup\": %.2f, \"same\": %s}\n",
+                   width, height, converter.name,
+                   converter.convert == GetCellConverter() ? "true" : "false",
+                   frameSeconds * 1e3, frameSeconds * 1e9 / ((double)width * height),
+                   scalarSeconds / frameSeconds, same ? "true" : "false");
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+// Steps a set of canonical scenes, built in code, at several resolutions and
+// prints one JSON object per scene and size, so engine changes can be
+// measured against a baseline:
+//
+//   scenebench -steps 200 -sizes 256,512,1024 -threads 1 [-scene water]
+//
+// Scenes: water, avalanche, oilfire, stove, acid, emitters
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CmdLine.h"
+#include "World.h"
+
+static double Seconds(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+//Filling the rectangle (x0,y0)-(x1,y1) with type, each cell 1 in chance
+static void Fill(World &world, FastRand &rand, int x0, int y0, int x1, int y1, ParticleType type, int chance)
+{
+    for(int y = y0; y <= y1; y++)
+        for(int x = x0; x <= x1; x++)
+            if(chance <= 1 || rand() % chance == 0)
+                world.Paint(x, y, 0, type);
+}
+
+//Walls on the sides and the bottom of the play area
+static void Tank(World &world)
+{
+    const int width = world.GetWidth();
+    const int height = world.GetHeight();
+    world.PaintLine(1, height/8, 1, height-3, 0, WALL);
+    world.PaintLine(width-2, height/8, width-2, height-3, 0, WALL);
+    world.PaintLine(1, height-3, width-2, height-3, 0, WALL);
+}
+
+//A tank filled to the brim with water, poured in unevenly so it sloshes
+static void BuildWater(World &world, FastRand &rand)
+{
+    Tank(world);
+    Fill(world, rand, 2, world.GetHeight()/8, world.GetWidth()-3, world.GetHeight()-4, WATER, 0);
+    Fill(world, rand, 2, world.GetHeight()/8, world.GetWidth()/2, world.GetHeight()/2, NOTHING, 3);
+}
+
+//A cliff of sand over the left half collapsing into the empty right half
+static void BuildAvalanche(World &world, FastRand &rand)
+{
+    Tank(world);
+    Fill(world, rand, 2, world.GetHeight()/8, world.GetWidth()/2, world.GetHeight()-4, SAND, 0);
+}
+
+//Shelves of plants soaked in oil, set alight at the bottom
+static void BuildOilFire(World &world, FastRand &rand)
+{
+    const int width = world.GetWidth();
+    const int height = world.GetHeight();
+    Tank(world);
+    Fill(world, rand, 2, height/4, width-3, height-4, PLANT, 2);
+    for(int y = height/4; y < height-4; y += 16)
+        Fill(world, rand, 2, y, width-3, y+3, OIL, 2);
+    world.PaintLine(2, height-4, width-3, height-4, 0, FIRE);
+}
+
+//Saltwater on a stove, boiling off into steam and salt
+static void BuildStove(World &world, FastRand &rand)
+{
+    const int width = world.GetWidth();
+    const int height = world.GetHeight();
+    Tank(world);
+    world.PaintLine(2, height-4, width-3, height-4, 0, STOVE);
+    Fill(world, rand, 2, height/2, width-3, height-5, SALTWATER, 0);
+}
+
+//Acid poured over blocks of plant, which it eats through
+static void BuildAcid(World &world, FastRand &rand)
+{
+    const int width = world.GetWidth();
+    const int height = world.GetHeight();
+    Tank(world);
+    for(int y = height/2; y < height-8; y += 12)
+        for(int x = 4; x < width-8; x += 12)
+            Fill(world, rand, x, y, x+5, y+5, PLANT, 0);
+    Fill(world, rand, 2, height/8, width-3, height/3, ACID, 2);
+}
+
+//Nothing but the game's emitters
+static void BuildEmitters(World &, FastRand &)
+{
+}
+
+//Emitting like the game does, for the emitters scene
+static void EmitLikeTheGame(World &world)
+{
+    const int width = world.GetWidth();
+    world.Emit(width/2 - (width/6)*2, 20, WATER, 0.3f);
+    world.Emit(width/2 - width/6, 20, SAND, 0.3f);
+    world.Emit(width/2 + width/6, 20, SALT, 0.3f);
+    world.Emit(width/2 + (width/6)*2, 20, OIL, 0.3f);
+}
+
+struct Scene
+{
+    const char *name;
+    void (*build)(World &world, FastRand &rand);
+    bool emit;
+};
+
+static const Scene SCENES[] =
+{
+    { "water", BuildWater, false },
+    { "avalanche", BuildAvalanche, false },
+    { "oilfire", BuildOilFire, false },
+    { "stove", BuildStove, false },
+    { "acid", BuildAcid, false },
+    { "emitters", BuildEmitters, true }
+};
+static const int SCENE_COUNT = sizeof(SCENES) / sizeof(SCENES[0]);
+
+int main(int argc, char **argv)
+{
+    CCmdLine cmdLine;
+    cmdLine.SplitLine(argc, argv);
+
+    int steps = atoi(cmdLine.GetSafeArgument("-steps", 0, "200").c_str());
+    int threads = atoi(cmdLine.GetSafeArgument("-threads", 0, "1").c_str());
+    unsigned int seed = strtoul(cmdLine.GetSafeArgument("-seed", 0, "1").c_str(), nullptr, 10);
+    std::string only = cmdLine.GetSafeArgument("-scene", 0, "");
+
+    std::vector<int> sizes;
+    std::istringstream list(cmdLine.GetSafeArgument("-sizes", 0, "256,512,1024"));
+    std::string item;
+    while(std::getline(list, item, ','))
+        sizes.push_back(atoi(item.c_str()));
+
+    if (steps < 1)
+    {
+        fprintf(stderr, "Invalid step count\n");
+        return 1;
+    }
+    for (int size : sizes)
+    {
+        if (size < 64)
+        {
+            fprintf(stderr, "Sizes start at 64\n");
+            return 1;
+        }
+    }
+
+    bool found = false;
+    for (int s = 0; s < SCENE_COUNT; s++)
+    {
+        const Scene &scene = SCENES[s];
+        if (!only.empty() && only != scene.name)
+            continue;
+        found = true;
+
+        for (int size : sizes)
+        {
+            World world(size, size);
+            world.Seed(seed);
+            world.SetThreads(threads);
+
+            FastRand rand;
+            rand.seed = seed;
+            scene.build(world, rand);
+
+            long long moved = 0;
+            long long awake = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < steps; i++)
+            {
+                if (scene.emit)
+                    EmitLikeTheGame(world);
+                world.Step();
+                moved += world.GetMovedCells();
+                awake += world.GetAwakeChunks();
+            }
+            double seconds = Seconds(start);
+            double cells = (double)size * size;
+
+            printf("{\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"threads\": %d, \"steps\": %d, "
+                   "\"seconds\": %.4f, \"steps_per_sec\": %.2f, \"ns_per_cell\": %.3f, "
+                   "\"moved_cells_per_sec\": %.0f, \"avg_awake_chunks\": %.1f, \"hash\": \"%016llx\"}\n",
+                   scene.name, size, size, world.GetThreads(), steps,
+                   seconds, steps / seconds, seconds * 1e9 / (steps * cells),
+                   moved / seconds, (double)awake / steps, (unsigned long long)world.GetHash());
+            fflush(stdout);
+        }
+    }
+
+    if (!found)
+    {
+        fprintf(stderr, "Unknown scene %s\n", only.c_str());
+        return 1;
+    }
+    return 0;
+}
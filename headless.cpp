@@ -0,0 +1,96 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Runs the simulation without a window, as fast as the CPU allows.
+//
+//   sandheadless -width 300 -height 158 -steps 1000 -seed 1 -threads 1 [-noemit]
+//                [-materials materials.txt] [-counterrand]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "CmdLine.h"
+#include "World.h"
+
+int main(int argc, char **argv)
+{
+    CCmdLine cmdLine;
+    cmdLine.SplitLine(argc, argv);
+
+    int width = atoi(cmdLine.GetSafeArgument("-width", 0, "300").c_str());
+    int height = atoi(cmdLine.GetSafeArgument("-height", 0, "158").c_str());
+    int steps = atoi(cmdLine.GetSafeArgument("-steps", 0, "1000").c_str());
+    unsigned int seed = strtoul(cmdLine.GetSafeArgument("-seed", 0, "1").c_str(), nullptr, 10);
+    int threads = atoi(cmdLine.GetSafeArgument("-threads", 0, "1").c_str());
+    bool emit = !cmdLine.HasSwitch("-noemit");
+
+    if (width < 3 || height < 3 || steps < 0)
+    {
+        fprintf(stderr, "Invalid world size or step count\n");
+        return 1;
+    }
+
+    World world(width, height);
+    world.Seed(seed);
+    world.SetThreads(threads);
+    if (cmdLine.HasSwitch("-counterrand"))
+        world.SetRandomMode(RANDOM_COUNTER);
+
+    if (cmdLine.HasSwitch("-materials"))
+    {
+        Materials materials;
+        std::string error;
+        if (!materials.Load(cmdLine.GetSafeArgument("-materials", 0, "materials.txt"), error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        world.SetMaterials(materials);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++)
+    {
+        // Same top emitters as the game starts with
+        if (emit)
+        {
+            world.Emit((width/2 - ((width/6)*2)), 20, WATER, 0.3f);
+            world.Emit((width/2 - (width/6)), 20, SAND, 0.3f);
+            world.Emit((width/2 + (width/6)), 20, SALT, 0.3f);
+            world.Emit((width/2 + ((width/6)*2)), 20, OIL, 0.3f);
+        }
+        world.Step();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%dx%d on %d thread(s), %d steps in %.3f s: %.1f steps/s, %.2f ns/cell, %d chunks awake\n",
+           width, height, world.GetThreads(), steps, seconds,
+           seconds > 0 ? steps / seconds : 0.0,
+           steps > 0 ? seconds * 1e9 / ((double)steps * width * height) : 0.0,
+           world.GetAwakeChunks());
+
+#ifdef SAND_PROFILE
+    world.GetProfile().Print(stdout, world.GetMaterials());
+#endif
+    return 0;
+}
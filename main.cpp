@@ -24,171 +24,35 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <vector>
 #include "SDL.h"
 
 #include "CmdLine.h"
+#include "World.h"
+#include "PhaseTimes.h"
+#include "PixelConvert.h"
+#include "Recording.h"
+#include "SimThread.h"
+#include "SurfaceScreen.h"
+#include "Trace.h"
 
 #ifdef __vita__
 #include <psp2/power.h>
 #endif
 
-#define FASTRAND_MAX 32767
-static unsigned int g_seed;
-
-inline void fast_srand( int seed ) {
-    g_seed = seed;
-}
-
-inline int fastrand() {
-    g_seed = (214013*g_seed+2531011);
-    return (g_seed>>16)&0x7FFF;
-}
-
-//The application time based timer
-class LTimer
-{
-public:
-    //Initializes variables
-    LTimer();
-
-    //The various clock actions
-    void start();
-    void stop();
-    void pause();
-    void unpause();
-
-    //Gets the timer's time
-    Uint32 getTicks();
-
-    //Checks the status of the timer
-    bool isStarted();
-    bool isPaused();
-
-private:
-    //The clock time when the timer started
-    Uint32 mStartTicks;
-
-    //The ticks stored when the timer was paused
-    Uint32 mPausedTicks;
-
-    //The timer status
-    bool mPaused;
-    bool mStarted;
-};
-
-LTimer::LTimer()
-{
-    //Initialize the variables
-    mStartTicks = 0;
-    mPausedTicks = 0;
-
-    mPaused = false;
-    mStarted = false;
-}
-
-void LTimer::start()
-{
-    //Start the timer
-    mStarted = true;
-
-    //Unpause the timer
-    mPaused = false;
-
-    //Get the current clock time
-    mStartTicks = SDL_GetTicks();
-    mPausedTicks = 0;
-}
-
-void LTimer::stop()
-{
-    //Stop the timer
-    mStarted = false;
-
-    //Unpause the timer
-    mPaused = false;
-
-    //Clear tick variables
-    mStartTicks = 0;
-    mPausedTicks = 0;
-}
-
-void LTimer::pause()
-{
-    //If the timer is running and isn't already paused
-    if( mStarted && !mPaused )
-    {
-        //Pause the timer
-        mPaused = true;
-
-        //Calculate the paused ticks
-        mPausedTicks = SDL_GetTicks() - mStartTicks;
-        mStartTicks = 0;
-    }
-}
-
-void LTimer::unpause()
-{
-    //If the timer is running and paused
-    if( mStarted && mPaused )
-    {
-        //Unpause the timer
-        mPaused = false;
-
-        //Reset the starting ticks
-        mStartTicks = SDL_GetTicks() - mPausedTicks;
-
-        //Reset the paused ticks
-        mPausedTicks = 0;
-    }
-}
-
-Uint32 LTimer::getTicks()
-{
-    //The actual timer time
-    Uint32 time = 0;
-
-    //If the timer is running
-    if( mStarted )
-    {
-        //If the timer is paused
-        if( mPaused )
-        {
-            //Return the number of ticks when the timer was paused
-            time = mPausedTicks;
-        }
-        else
-        {
-            //Return the current time minus the start time
-            time = SDL_GetTicks() - mStartTicks;
-        }
-    }
-
-    return time;
-}
-
-bool LTimer::isStarted()
-{
-    //Timer is running and paused or unpaused
-    return mStarted;
-}
-
-bool LTimer::isPaused()
-{
-    //Timer is running and paused
-    return mPaused && mStarted;
-}
-
-
 int JOY_DEADZONE = 500;
 
 //Screen size
 int WIDTH;
 int HEIGHT;
 
-// FPS
-const int SCREEN_FPS = 30;
-const int SCREEN_TICKS_PER_FRAME = 1000 / SCREEN_FPS;
+// Simulation ticks per second, unless told otherwise with -tickrate
+const int DEFAULT_TICK_RATE = 30;
+
+// Most ticks run back to back when the simulation falls behind
+const int MAX_TICKS_PER_FRAME = 4;
 
 //Button sizes
 int BUTTON_SIZE = 10;
@@ -198,9 +62,50 @@ int LOWER_ROW_Y;
 
 const int DASHBOARD_HEIGHT = BUTTON_SIZE + 2;
 
-int particleCount = 0;
 int penSize = 2;
 
+// Show the material census over the scene (F1)
+bool showCensus = false;
+
+// The phases of a frame, timed for the overlay (F2) and -timings
+enum FramePhase
+{
+    PHASE_EVENTS,     // polling and handling events
+    PHASE_INPUT,      // moving the camera and cursor, input for the simulation
+    PHASE_EMIT,       // simulation thread: strokes, emitters and the brush
+    PHASE_STEP,       // simulation thread: World::Step()
+    PHASE_SCENE,      // DrawScene()
+    PHASE_DASHBOARD,  // buttons, cursor and overlays
+    PHASE_PRESENT,    // SDL_RenderPresent()
+    PHASE_COUNT
+};
+
+const char *PHASE_NAMES[PHASE_COUNT] = { "events", "input", "emit", "step", "scene", "dashboard", "present" };
+
+const SDL_Color PHASE_COLORS[PHASE_COUNT] =
+{
+    { 255, 255, 255, 255 },
+    { 160, 160, 160, 255 },
+    { 0, 200, 255, 255 },
+    { 0, 90, 255, 255 },
+    { 255, 200, 0, 255 },
+    { 255, 110, 0, 255 },
+    { 255, 0, 90, 255 }
+};
+
+// A frame twice as long as it may be at 60 fps fills the width of the overlay
+const double TIMINGS_FULL_SCALE = 2.0 / 60.0;
+
+PhaseTimes frameTimes(PHASE_COUNT);
+bool showTimings = false;
+
+// Frames left to show the simulation as behind in the overlay: the last
+// PhaseTimes::WINDOW frames after it dropped ticks
+int behindFrames = 0;
+
+// Written when started with -timings
+FILE *timingsFile = nullptr;
+
 int mbx;
 int mby;
 
@@ -210,79 +115,23 @@ int canMoveY = 0;
 int speedX = 0;
 int speedY = 0;
 
-//Init and declare ParticleSwapping
-bool implementParticleSwaps = true;
-
+// The part of the world shown on the screen, when the world is larger
+int worldWidth;
+int worldHeight;
+int cameraX = 0;
+int cameraY = 0;
+int cameraSpeedX = 0;
+int cameraSpeedY = 0;
 
 
-/* 
-Enumerating conventions
------------------------
-Stillborn: between STILLBORN_UPPER_BOUND and STILLBORN_LOWER_BOUND
-Floating: between FLOATING_UPPER_BOUND and FLOATING_LOWER_BOUND
-*/
-const int STILLBORN_UPPER_BOUND = 14;
-const int STILLBORN_LOWER_BOUND = 1;
-const int FLOATING_UPPER_BOUND = 35;
-const int FLOATING_LOWER_BOUND = 32;
+// The particle system
+World *world;
 
-enum ParticleType
-{
-    // STILLBORN
-    NOTHING = 0,
-    WALL = 1,
-    IRONWALL = 2,
-    TORCH = 3,
-    //x = 4,
-    STOVE = 5,
-    ICE = 6,
-    RUST = 7,
-    EMBER = 8,
-    PLANT = 9,
-    VOID = 10,
-
-    //SPOUTS
-    WATERSPOUT = 11,
-    SANDSPOUT = 12,
-    SALTSPOUT = 13,
-    OILSPOUT = 14,
-    //x = 15,
-
-    //ELEMENTAL
-    WATER = 16,
-    MOVEDWATER = 17,
-    DIRT = 18,
-    MOVEDDIRT = 19,
-    SALT = 20,
-    MOVEDSALT = 21,
-    OIL = 22,
-    MOVEDOIL = 23,
-    SAND = 24,
-    MOVEDSAND = 25,
-
-    //COMBINED
-    SALTWATER = 26,
-    MOVEDSALTWATER = 27,
-    MUD = 28,
-    MOVEDMUD = 29,
-    ACID = 30,
-    MOVEDACID = 31,
-
-    //FLOATING
-    STEAM = 32,
-    MOVEDSTEAM = 33,
-    FIRE = 34,
-    MOVEDFIRE = 35,
-
-    //ELECTRICITY
-    ELEC = 36,
-    MOVEDELEC = 37
-};
+// Input of the session, written when started with -record
+Recorder recorder;
 
-// Instead of using a two-dimensional array
-// we'll use a simple array to improve speed
-// vs = virtual screen
-ParticleType *vs;
+// Steps the world on its own thread, hands finished grids to DrawScene
+SimThread *sim;
 
 // The current brush type
 ParticleType CurrentParticleType = WALL;
@@ -304,983 +153,365 @@ ButtonRect Button[BUTTON_COUNT];
 // The particle system play area
 SDL_Rect scene;
 
+// The buttons under it
+SDL_Rect dashboard;
+
+// The dashboard as last drawn, and what it showed (see drawDashboard)
+SDL_Texture *dashboard_texture = nullptr;
+bool dashboardDirty = true;
+ParticleType dashboardType;
+int dashboardPenSize;
+
 SDL_Window *window;
 SDL_Renderer *renderer;
-SDL_Texture *scene_texture;
-uint32_t *screen_buffer;
+SDL_Texture *scene_texture = nullptr;
 
-//Checks wether a given particle type is a stillborn element
-static inline bool IsStillborn(ParticleType t)
-{
-    return (t >= STILLBORN_LOWER_BOUND && t <= STILLBORN_UPPER_BOUND);
-}
+// Draws into the window surface instead of the renderer, when asked to
+// (-software) or when there is no GPU
+bool softwareScreen = false;
+SurfaceScreen *surfaceScreen = nullptr;
+
+// The 32 bit format the renderer (or the window surface) takes as it is,
+// the scene is drawn in it
+SDL_PixelFormat *scene_format;
+
+// Screen rectangles the overlays and the cursor were drawn over, this frame
+// and the last. The window surface keeps its pixels from frame to frame, so
+// what is under them has to be drawn again.
+std::vector<SDL_Rect> overlaid;
+std::vector<SDL_Rect> lastOverlaid;
+
+// The window surface was taken again or the renderer lost its textures,
+// nothing of the last frame is left
+bool screenReset = false;
+
+// Colors by material id. Materials without a color in the table are left at
+// alpha 0.
+SDL_Color colors[MAX_MATERIALS];
+
+// The colors packed into scene texture pixels, by cell value, so turning a
+// cell into a pixel is a single load. 256 bytes, on cache line boundaries.
+alignas(64) Uint32 palette[MAX_MATERIALS];
 
-//Checks wether a given particle type is a floting type - like FIRE and STEAM
-static inline bool IsFloating(ParticleType t)
+// Initializing colors, from the material table
+void initColors()
 {
-    return (t >= FLOATING_LOWER_BOUND && t <= FLOATING_UPPER_BOUND);
+    const Materials &materials = world->GetMaterials();
+    for(int t = 0; t < MAX_MATERIALS; t++)
+    {
+        const unsigned char *rgb = materials.GetColor(t);
+        colors[t] = { rgb[0], rgb[1], rgb[2], (Uint8)(materials.HasColor(t) ? 255 : 0) };
+    }
+    // Empty cells are what the uncolored ones fall back to, black if the
+    // table says nothing
+    colors[NOTHING].a = 255;
 }
 
-//Checks wether a given particle type is burnable - like PLANT and OIL
-static inline bool IsBurnable(ParticleType t)
+// Packing a color into a pixel of the scene texture
+static inline Uint32 PackColor(const SDL_Color &color)
 {
-    return (t == PLANT || t == OIL || t == MOVEDOIL);
+    const SDL_PixelFormat *f = scene_format;
+    return ((Uint32)(color.r >> f->Rloss) << f->Rshift)
+         | ((Uint32)(color.g >> f->Gloss) << f->Gshift)
+         | ((Uint32)(color.b >> f->Bloss) << f->Bshift)
+         | f->Amask;
 }
 
-//Checks wether a given particle type is burnable - like PLANT and OIL
-static inline bool BurnsAsEmber(ParticleType t)
+// Building the palette for a pixel format. Uncolored materials show up
+// black, as empty cells do.
+static void InitPalette(Uint32 format)
 {
-    return (t == PLANT); //Maybe we'll add a FUSE or WOOD
+    if(scene_format)
+        SDL_FreeFormat(scene_format);
+    scene_format = SDL_AllocFormat(format);
+
+    for(int t = 0; t < MAX_MATERIALS; t++)
+        palette[t] = PackColor(colors[t].a != 0 ? colors[t] : colors[NOTHING]);
 }
 
-std::map<ParticleType, SDL_Color> colors;
+// The color FillRects() fills with, packed for the window surface
+Uint32 drawColor;
 
-// Initializing colors
-void initColors()
+// Drawing flat rectangles, with the renderer or into the window surface
+static void SetDrawColor(Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 {
-    //STILLBORN
-    colors[SAND]		= { 238, 204, 128, 255};
-    colors[WALL]		= { 100, 100, 100, 255};
-    colors[VOID]		= { 60, 60, 60, 255};
-    colors[IRONWALL]	= { 110, 110, 110, 255};
-    colors[TORCH]		= { 139, 69, 19, 255};
-    colors[STOVE]		= { 74, 74, 74, 255};
-    colors[ICE]			= { 175, 238, 238, 255};
-    colors[PLANT]		= { 0, 150, 0, 255};
-    colors[EMBER]		= { 127, 25, 25, 255};
-    colors[RUST]		= { 110, 40, 10, 255};
-
-    //ELEMENTAL
-    colors[WATER]		= { 32, 32, 255, 255};
-    colors[DIRT]		= { 205, 175, 149, 255};
-    colors[SALT]		= { 255, 255, 255, 255};
-    colors[OIL]			= { 128, 64, 64, 255};
-
-    //COMBINED
-    colors[MUD]			= { 139, 69, 19, 255};
-    colors[SALTWATER]	= { 65, 105, 225, 255};
-    colors[STEAM]		= { 95, 158, 160, 255};
-
-    //EXTRA
-    colors[ACID]		= { 173, 255, 47, 255};
-    colors[FIRE]		= { 255, 50, 50, 255};
-    colors[ELEC]		= { 255, 255, 0, 255};
-
-    //SPOUTS
-    colors[WATERSPOUT]	= { 0, 0, 128, 255};
-    colors[SANDSPOUT]	= { 240, 230, 140, 255};
-    colors[SALTSPOUT]	= { 238, 233, 233, 255};
-    colors[OILSPOUT]	= { 108, 44, 44, 255};
+    if(surfaceScreen)
+        drawColor = PackColor({ r, g, b, a });
+    else
+        SDL_SetRenderDrawColor(renderer, r, g, b, a);
 }
 
-//Drawing our virtual screen to the real screen
-static void DrawScene()
+static void FillRects(const SDL_Rect *rects, int count)
 {
-    particleCount = 0;
-
-    size_t framebuf_size = scene.w * scene.h * 3 * sizeof(Uint8);
-    auto* pixels = static_cast<Uint8 *>(malloc(framebuf_size));
-    memset(pixels, 0, framebuf_size);
-
-    //Iterating through each pixel height first
-    for(int y=scene.h;y--;)
+    if(surfaceScreen)
     {
-        //Width
-        for(int x=scene.w;x--;)
-        {
-            const unsigned int offset = ( scene.w * 3 * y ) + x * 3;
-            int index = x+(scene.w*y);
-            ParticleType same = vs[index];
-            if(same != NOTHING)
-            {
-                if(IsStillborn(same)) {
-
-                    pixels[ offset + 0 ] = colors[same].r;
-                    pixels[ offset + 1 ] = colors[same].g;
-                    pixels[ offset + 2 ] = colors[same].b;
-                } else
-                {
-                    particleCount++;
-                    if(same % 2 == 1) //Moved
-                    {
-                        pixels[ offset + 0 ] = colors[(ParticleType)(same-1)].r;
-                        pixels[ offset + 1 ] = colors[(ParticleType)(same-1)].g;
-                        pixels[ offset + 2 ] = colors[(ParticleType)(same-1)].b;
-                        vs[index] = (ParticleType)(same-1); //Set it to not moved
-                    }
-                    else {			//Not moved
-                        pixels[ offset + 0 ] = colors[same].r;
-                        pixels[ offset + 1 ] = colors[same].g;
-                        pixels[ offset + 2 ] = colors[same].b;
-                    }
-                }
-            }
-        }
+        for(int i = 0; i < count; i++)
+            surfaceScreen->FillRect(rects[i], drawColor);
     }
+    else
+        SDL_RenderFillRects(renderer, rects, count);
+}
 
-    SDL_UpdateTexture(scene_texture, nullptr, pixels, scene.w * 3);
-    free(pixels);
-    SDL_RenderCopy(renderer, scene_texture, nullptr, &scene);
+static void FillRect(const SDL_Rect &rect)
+{
+    FillRects(&rect, 1);
 }
 
-// Emitting a given particletype at (x,o) width pixels wide and
-// with a p density (probability that a given pixel will be drawn
-// at a given position withing the width)
-void Emit(int x, int width, ParticleType type, float p)
+// Remembering a rectangle drawn over the scene
+static void Overlay(const SDL_Rect &rect)
 {
-    for (int i = x - width/2; i < x + width/2; i++)
-    {
-        if ( fastrand() < (int)(FASTRAND_MAX * p) ) vs[i+WIDTH] = type;
-    }
+    if(surfaceScreen)
+        overlaid.push_back(rect);
 }
 
-//Performs logic of stillborn particles
-void StillbornParticleLogic(int x,int y,ParticleType type)
+// Converting a rectangle of the frame into the scene texture. The pixels
+// go straight into the texture, in its own format, so nothing is allocated
+// or converted on the way; the palette lookups run in the vector kernel the
+// CPU is best at (PixelConvert.h).
+static void UploadRect(const Cell *vs, const SDL_Rect &rect)
 {
-    int index, above, left, right, below, same, abovetwo;
-    switch(type)
+    if(surfaceScreen)
     {
+        surfaceScreen->DrawCells(vs + rect.x + scene.w*rect.y, scene.w, rect, palette);
+        return;
+    }
 
-        case VOID:
-            above = x+((y-1)*WIDTH);
-            left = (x+1)+(y*WIDTH);
-            right = (x-1)+(y*WIDTH);
-            below = x+((y+1)*WIDTH);
-            if(vs[above] != NOTHING)
-                vs[above] = NOTHING;
-            if(vs[below] != NOTHING)
-                vs[below] = NOTHING;
-            if(vs[left] != NOTHING)
-                vs[left] = NOTHING;
-            if(vs[right] != NOTHING)
-                vs[right] = NOTHING;
-            break;
-        case IRONWALL:
-            above = x+((y-1)*WIDTH);
-            left = (x+1)+(y*WIDTH);
-            right = (x-1)+(y*WIDTH);
-            if(fastrand()%200 == 0 && (vs[above] == RUST || vs[left] == RUST || vs[right] == RUST))
-                vs[x+(y*WIDTH)] = RUST;
-            break;
-        case TORCH:
-            above = x+((y-1)*WIDTH);
-            left = (x+1)+(y*WIDTH);
-            right = (x-1)+(y*WIDTH);
-            if(fastrand()%2 == 0) // Spawns fire
-            {
-                if(vs[above] == NOTHING || vs[above] == MOVEDFIRE) //Fire above
-                    vs[above] = MOVEDFIRE;
-                if(vs[right] == NOTHING || vs[right] == MOVEDFIRE) //Fire to the right
-                    vs[right] = MOVEDFIRE;
-                if(vs[left] == NOTHING || vs[left] == MOVEDFIRE) //Fire to the left
-                    vs[left] = MOVEDFIRE;
-            }
-            if(vs[above] == MOVEDWATER || vs[above] == WATER) //Fire above
-                vs[above] = MOVEDSTEAM;
-            if(vs[right] == MOVEDWATER || vs[right] == WATER) //Fire to the right
-                vs[right] = MOVEDSTEAM;
-            if(vs[left] == MOVEDWATER || vs[left] == WATER) //Fire to the left
-                vs[left] = MOVEDSTEAM;
-
-            break;
-        case PLANT:
-            if(fastrand()%2 == 0) //Making the plant grow slowly
-            {
-                index = 0;
-                switch(fastrand()%4)
-                {
-                    case 0: index = (x-1)+(y*WIDTH); break;
-                    case 1: index = x+((y-1)*WIDTH); break;
-                    case 2: index = (x+1)+(y*WIDTH); break;
-                    case 3:	index = x+((y+1)*WIDTH); break;
-                }
-                if(vs[index] == WATER)
-                    vs[index] = PLANT;
-            }
-            break;
-        case EMBER:
-            below = x+((y+1)*WIDTH);
-            if(vs[below] == NOTHING || IsBurnable(vs[below]))
-                vs[below] = FIRE;
-
-            index = 0;
-            switch(fastrand()%4)
-            {
-                case 0: index = (x-1)+(y*WIDTH); break;
-                case 1: index = x+((y-1)*WIDTH); break;
-                case 2: index = (x+1)+(y*WIDTH); break;
-                case 3:	index = x+((y+1)*WIDTH); break;
-            }
-            if(vs[index] == PLANT)
-                vs[index] = FIRE;
-
-            if(fastrand()%18 == 0) // Making ember burn out slowly
-                vs[x+(y*WIDTH)] = NOTHING;
-            break;
-        case STOVE:
-            above = x+((y-1)*WIDTH);
-            abovetwo = x+((y-2)*WIDTH);
-            if(fastrand()%4 == 0 && vs[above] == WATER) // Boil the water
-                vs[above] = STEAM;
-            if(fastrand()%4 == 0 && vs[above] == SALTWATER) // Saltwater separates
-            {
-                vs[above] = SALT;
-                vs[abovetwo] = STEAM;
-            }
-            if(fastrand()%8 == 0 && vs[above] == OIL) // Set oil aflame
-                vs[above] = EMBER;
-            break;
-        case RUST:
-            if(fastrand()%7000 == 0)//Deteriate rust
-                vs[x+(y*WIDTH)] = NOTHING;
-            break;
-
-
-            //####################### SPOUTS #######################
-        case WATERSPOUT:
-            if(fastrand()%6 == 0) // Take it easy on the spout
-            {
-                below = x+((y+1)*WIDTH);
-                if (vs[below] == NOTHING)
-                    vs[below] = MOVEDWATER;
-            }
-            break;
-        case SANDSPOUT:
-            if(fastrand()%6 == 0) // Take it easy on the spout
-            {
-                below = x+((y+1)*WIDTH);
-                if (vs[below] == NOTHING)
-                    vs[below] = MOVEDSAND;
-            }
-            break;
-        case SALTSPOUT:
-            if(fastrand()%6 == 0) // Take it easy on the spout
-            {
-
-                below = x+((y+1)*WIDTH);
-                if (vs[below] == NOTHING)
-                    vs[below] = MOVEDSALT;
-                if(vs[below] == WATER || vs[below] == MOVEDWATER)
-                    vs[below] = MOVEDSALTWATER;
-            }
-            break;
-        case OILSPOUT:
-            if(fastrand()%6 == 0) // Take it easy on the spout
-            {
-                below = x+((y+1)*WIDTH);
-                if (vs[below] == NOTHING)
-                    vs[below] = MOVEDOIL;
-            }
-            break;
+    void *pixels;
+    int pitch;
+    if(SDL_LockTexture(scene_texture, &rect, &pixels, &pitch) != 0)
+        return;
 
-        default:
-            break;
-    }
+    GetCellConverter()(vs + rect.x + scene.w*rect.y, scene.w, rect.w, rect.h, palette, (Uint32 *)pixels, pitch);
 
+    SDL_UnlockTexture(scene_texture);
 }
 
-// Performing the movement logic of a given particle. The argument 'type'
-// is passed so that we don't need a table lookup when determining the
-// type to set the given particle to - i.e. if the particle is SAND then the
-// passed type will be MOVEDSAND
-inline void MoveParticle(int x, int y, ParticleType type)
+//Drawing our virtual screen to the real screen. The texture keeps the frame
+//drawn last, so only what changed since then is converted and uploaded.
+static void DrawScene()
 {
+    static unsigned int drawnFrame = 0;
+    static int drawnViewX;
+    static int drawnViewY;
 
-    type = (ParticleType)(type+1);
-
+    const Cell *vs = sim->GetFrame();
+    const SimChanges &changes = sim->GetChanges();
 
-    int above = x+((y-1)*WIDTH);
-    int same = x+(WIDTH*y);
-    int below = x+((y+1)*WIDTH);
+    lastOverlaid.swap(overlaid);
+    overlaid.clear();
 
-
-    //If nothing below then just fall (gravity)
-    if(!IsFloating(type))
     {
-        if ( (vs[below] == NOTHING) && (fastrand() % 8)) //fastrand() % 8 makes it spread
-        {
-            vs[below] = type;
-            vs[same] = NOTHING;
-            return;
-        }
-    }
-    else
-    {
-        if(fastrand()%3 == 0) //Slow down please
-            return;
+        TraceZone zone("upload", "rects", (int)changes.rects.size());
 
-        //If nothing above then rise (floating - or reverse gravity? ;))
-        if ((vs[above] == NOTHING || vs[above] == FIRE) && (fastrand() % 8) && (vs[same] != ELEC) && (vs[same] != MOVEDELEC)) //fastrand() % 8 makes it spread
+        //Nothing to build on after scrolling
+        if(drawnFrame == 0 || drawnFrame < changes.since || changes.viewX != drawnViewX || changes.viewY != drawnViewY || screenReset)
         {
-            if (type == MOVEDFIRE && fastrand()%20 == 0)
-                vs[same] = NOTHING;
-            else
-            {
-                vs[above] = vs[same];
-                vs[same] = NOTHING;
-            }
-            return;
+            SDL_Rect all = { 0, 0, scene.w, scene.h };
+            UploadRect(vs, all);
         }
-
-    }
-
-    //Randomly select right or left first
-    int sign = fastrand() % 2 == 0 ? -1 : 1;
-
-    // We'll only calculate these indicies once for optimization purpose
-    int first = (x+sign)+(WIDTH*y);
-    int second = (x-sign)+(WIDTH*y);
-
-    int index = 0;
-    //Particle type specific logic
-    switch(type)
-    {
-        case MOVEDELEC:
-            if(fastrand()%2 == 0)
-                vs[same] = NOTHING;
-            break;
-        case MOVEDSTEAM:
-            if(fastrand()%1000 == 0)
-            {
-                vs[same] = MOVEDWATER;
-                return;
-            }
-            if(fastrand()%500 == 0)
-            {
-                vs[same] = NOTHING;
-                return;
-            }
-            if(!IsStillborn(vs[above]) && !IsFloating(vs[above]))
+        else
+        {
+            for(const SimRect &changed : changes.rects)
             {
-                if(fastrand()%15 == 0)
-                {
-                    vs[same] = NOTHING;
-                    return;
-                }
-                else
-                {
-                    vs[same] = vs[above];
-                    vs[above] = MOVEDSTEAM;
-                    return;
-                }
+                SDL_Rect rect = { changed.x, changed.y, changed.w, changed.h };
+                UploadRect(vs, rect);
             }
-            break;
-        case MOVEDFIRE:
 
-            if(!IsBurnable(vs[above]) && fastrand()%10 == 0)
+            //The renderer starts every frame from scratch, the window
+            //surface still has last frame's overlays on it
+            for(const SDL_Rect &over : lastOverlaid)
             {
-                vs[same] = NOTHING;
-                return;
-            }
-
-            // Let the snowman melt!
-            if(fastrand()%4 == 0)
-            {
-                if (vs[above] == ICE)
-                {
-                    vs[above] = WATER;
-                    vs[same] = NOTHING;
-                }
-                if (vs[below] == ICE)
-                {
-                    vs[below] = WATER;
-                    vs[same] = NOTHING;
-                }
-                if (vs[first] == ICE)
-                {
-                    vs[first] = WATER;
-                    vs[same] = NOTHING;
-                }
-                if (vs[second] == ICE)
-                {
-                    vs[second] = WATER;
-                    vs[same] = NOTHING;
-                }
+                SDL_Rect rect;
+                if(SDL_IntersectRect(&over, &scene, &rect))
+                    UploadRect(vs, rect);
             }
+        }
+    }
 
-            //Let's burn whatever we can!
-            index = 0;
-            switch(fastrand()%4)
-            {
-                case 0: index = above; break;
-                case 1: index = below; break;
-                case 2: index = first; break;
-                case 3:	index = second; break;
-            }
-            if(IsBurnable(vs[index]))
-            {
-                if(BurnsAsEmber(vs[index]))
-                    vs[index] = EMBER;
-                else
-                    vs[index] = FIRE;
-            }
-            break;
-        case MOVEDWATER:
-            if(fastrand()%200 == 0 && vs[below] == IRONWALL)
-                vs[below] = RUST;
+    drawnFrame = changes.frame;
+    drawnViewX = changes.viewX;
+    drawnViewY = changes.viewY;
+    screenReset = false;
 
-            if(vs[below]  == FIRE || vs[above] == FIRE || vs[first] == FIRE || vs[second] == FIRE)
-                vs[same] = MOVEDSTEAM;
+    if(!surfaceScreen)
+        SDL_RenderCopy(renderer, scene_texture, nullptr, &scene);
+}
 
-            //Making water+dirt into dirt
-            if(vs[below] == DIRT)
-            {
-                vs[below] = MOVEDMUD;
-                vs[same] = NOTHING;
-            }
-            if(vs[above] == DIRT)
-            {
-                vs[above] = MOVEDMUD;
-                vs[same] = NOTHING;
-            }
+// Drawing the census as a bar across the top of the scene: every material
+// as wide as its share of all the particles in the world
+void drawCensus()
+{
+    const int *counts = sim->GetCounts();
+    long long total = 0;
+    for(int t = NOTHING+1; t < MAX_MATERIALS; t++)
+        total += counts[t];
+
+    SDL_Rect bar = { scene.x, scene.y, scene.w, 3 };
+    SetDrawColor(0, 0, 0, 255);
+    FillRect(bar);
+    Overlay(bar);
+
+    long long sum = 0;
+    for(int t = NOTHING+1; t < MAX_MATERIALS && total > 0; t++)
+    {
+        if(counts[t] == 0)
+            continue;
 
-            //Making water+salt into saltwater
-            if(vs[above] == SALT || vs[above] == MOVEDSALT)
-            {
-                vs[above] = MOVEDSALTWATER;
-                vs[same] = NOTHING;
-            }
-            if(vs[below] == SALT || vs[below] == MOVEDSALT)
-            {
-                vs[below] = MOVEDSALTWATER;
-                vs[same] = NOTHING;
-            }
+        int x0 = (int)(sum * scene.w / total);
+        sum += counts[t];
+        int x1 = (int)(sum * scene.w / total);
 
-            if(fastrand()%60 == 0) //Melting ice
-            {
-                switch(fastrand()%4)
-                {
-                    case 0:	index = above; break;
-                    case 1:	index = below; break;
-                    case 2:	index = first; break;
-                    case 3:	index = second; break;
-                }
-                if(vs[index] == ICE)vs[index] = WATER; //--
-            }
-            break;
-        case MOVEDACID:
-            switch(fastrand()%4)
-            {
-                case 0:	index = above; break;
-                case 1:	index = below; break;
-                case 2:	index = first; break;
-                case 3:	index = second; break;
-            }
-            if(vs[index] != WALL && vs[index] != IRONWALL && vs[index] != WATER && vs[index] != MOVEDWATER && vs[index] != ACID && vs[index] != MOVEDACID) vs[index] = NOTHING;	break;
-            break;
-        case MOVEDSALT:
-            if(fastrand()%20 == 0)
-            {
-                switch(fastrand()%4)
-                {
-                    case 0:	index = above; break;
-                    case 1:	index = below; break;
-                    case 2:	index = first; break;
-                    case 3:	index = second; break;
-                }
-                if(vs[index] == ICE)vs[index] = WATER; //--
-            }
-            break;
-        case MOVEDSALTWATER:
-            //Saltwater separated by heat
-            //	if (vs[above] == FIRE || vs[below] == FIRE || vs[first] == FIRE || vs[second] == FIRE || vs[above] == STOVE || vs[below] == STOVE || vs[first] == STOVE || vs[second] == STOVE)
-            //	{
-            //		vs[same] = SALT;
-            //		vs[above] = STEAM;
-            //	}
-            if(fastrand()%40 == 0) //Saltwater dissolves ice more slowly than pure salt
-            {
-                switch(fastrand()%4)
-                {
-                    case 0:	index = above; break;
-                    case 1:	index = below; break;
-                    case 2:	index = first; break;
-                    case 3:	index = second; break;
-                }
-                if(vs[index] == ICE)vs[index] = WATER;
-            }
-            break;
-        case MOVEDOIL:
-            switch(fastrand()%4)
-            {
-                case 0:	index = above; break;
-                case 1:	index = below; break;
-                case 2:	index = first; break;
-                case 3:	index = second; break;
-            }
-            if(vs[index] == FIRE)
-                vs[same] = FIRE;
-            break;
+        // Materials of a custom table without a color of their own
+        const SDL_Color &color = colors[t];
+        if(color.a != 0)
+            SetDrawColor(color.r, color.g, color.b, 255);
+        else
+            SetDrawColor(255, 0, 255, 255);
 
-        default:
-            break;
+        SDL_Rect part = { scene.x + x0, scene.y, x1 - x0, 3 };
+        FillRect(part);
     }
+}
 
-    //Peform 'realism' logic?
-    // When adding dynamics to this part please use the following structure:
-    // If a particle A is ligther than particle B then add vs[above] == B to the condition in case A (case MOVED_A)
-    if(implementParticleSwaps)
-    {
-        switch(type)
-        {
-            case MOVEDWATER:
-                if(vs[above] == SAND || vs[above] == MUD || vs[above] == SALTWATER && fastrand()%3 == 0)
-                {
-                    vs[same] = vs[above];
-                    vs[above] = type;
-                    return;
-                }
-                break;
-            case MOVEDOIL:
-                if(vs[above] == WATER && fastrand()%3 == 0)
-                {
-                    vs[same] = vs[above];
-                    vs[above] = type;
-                    return;
-                }
-                break;
-            case MOVEDSALTWATER:
-                if(vs[above] == DIRT || vs[above] == MUD || vs[above] == SAND && fastrand()%3 == 0)
-                {
-                    vs[same] = vs[above];
-                    vs[above] = type;
-                    return;
-                }
-                break;
+// Drawing the frame timings under the census bar: a row per phase, as long
+// as its average, with a mark at its worst case. The grey line is the time
+// a frame may take at 60 fps.
+void drawTimings()
+{
+    int scale = scene.w;
+    SDL_Rect back = { scene.x, scene.y + 4, scene.w, 3 * PHASE_COUNT + 1 };
+    SetDrawColor(0, 0, 0, 255);
+    FillRect(back);
+    Overlay(back);
 
-            default:
-                break;
-        }
+    for(int i = 0; i < PHASE_COUNT; i++)
+    {
+        const SDL_Color &color = PHASE_COLORS[i];
+        SetDrawColor(color.r, color.g, color.b, 255);
+
+        int average = (int)(frameTimes.GetAverage(i) / TIMINGS_FULL_SCALE * scale);
+        int worst = (int)(frameTimes.GetWorst(i) / TIMINGS_FULL_SCALE * scale);
+        SDL_Rect bar = { scene.x, back.y + 1 + 3 * i, average < scale ? average : scale, 2 };
+        SDL_Rect mark = { scene.x + (worst < scale ? worst : scale - 1), bar.y, 1, 2 };
+        FillRect(bar);
+        FillRect(mark);
     }
 
-    // The place below (x,y+1) is filled with something, then check (x+sign,y+1) and (x-sign,y+1)
-    // We chose sign randomly to randomly check eigther left or right
-    // This is for elements that fall downward
-    if (!IsFloating(type))
-    {
-        int firstdown = (x+sign)+((y+1)*WIDTH);
-        int seconddown = (x-sign)+((y+1)*WIDTH);
+    SDL_Rect budget = { scene.x + scale / 2, back.y, 1, back.h };
+    SetDrawColor(128, 128, 128, 255);
+    FillRect(budget);
 
-        if ( vs[firstdown] == NOTHING)
-        {
-            vs[firstdown] = type;
-            vs[same] = NOTHING;
-        }
-        else if ( vs[seconddown] == NOTHING)
-        {
-            vs[seconddown] = type;
-            vs[same] = NOTHING;
-        }
-            //If (x+sign,y+1) is filled then try (x+sign,y) and (x-sign,y)
-        else if (vs[first] == NOTHING)
-        {
-            vs[first] = type;
-            vs[same] = NOTHING;
-        }
-        else if (vs[second] == NOTHING)
-        {
-            vs[second] = type;
-            vs[same] = NOTHING;
-        }
-    }
-        // Make steam move
-    else if(type == MOVEDSTEAM)
+    //The simulation couldn't keep up and dropped ticks lately
+    if(behindFrames > 0)
     {
-        int firstup = (x+sign)+((y-1)*WIDTH);
-        int secondup = (x-sign)+((y-1)*WIDTH);
-
-        if ( vs[firstup] == NOTHING)
-        {
-            vs[firstup] = type;
-            vs[same] = NOTHING;
-        }
-        else if ( vs[secondup] == NOTHING)
-        {
-            vs[secondup] = type;
-            vs[same] = NOTHING;
-        }
-            //If (x+sign,y+1) is filled then try (x+sign,y) and (x-sign,y)
-        else if (vs[first] == NOTHING)
-        {
-            vs[first] = type;
-            vs[same] = NOTHING;
-        }
-        else if (vs[second] == NOTHING)
-        {
-            vs[second] = type;
-            vs[same] = NOTHING;
-        }
+        SDL_Rect behind = { scene.x + scene.w - 4, back.y + 1, 3, 3 };
+        SetDrawColor(255, 0, 0, 255);
+        FillRect(behind);
     }
 }
 
-//Drawing a filled circle at a given position with a given radius and a given partice type
-void DrawParticles(int xpos, int ypos, int radius, ParticleType type)
+// Opening the -timings file, a line per frame with the milliseconds every
+// phase took
+static bool OpenTimings(const char *path)
 {
-    for (int x = ((xpos - radius - 1) < 0) ? 0 : (xpos - radius - 1); x <= xpos + radius && x < WIDTH; x++) {
-        for (int y = ((ypos - radius - 1) < 0) ? 0 : (ypos - radius - 1); y <= ypos + radius && y < HEIGHT; y++)
-        {
-            if ((x-xpos)*(x-xpos) + (y-ypos)*(y-ypos) <= radius*radius) vs[x+(WIDTH*y)] = type;
-        }
-    }
+    timingsFile = fopen(path, "w");
+    if(!timingsFile)
+        return false;
+
+    fprintf(timingsFile, "frame,ticks,dropped_ticks");
+    for(int i = 0; i < PHASE_COUNT; i++)
+        fprintf(timingsFile, ",%s_ms", PHASE_NAMES[i]);
+    fprintf(timingsFile, "\n");
+    return true;
 }
 
-// Drawing a line
-void DrawLine(int newx, int newy, int oldx, int oldy)
+// Writing the last frame to the -timings file
+static void WriteTimings(const SimTimes &simTimes)
 {
-    if(newx == oldx && newy == oldy)
-    {
-        DrawParticles(newx,newy,penSize,CurrentParticleType);
-    }
-    else
-    {
-        float step = 1.0f / ((abs(newx-oldx)>abs(newy-oldy)) ? abs(newx-oldx) : abs(newy-oldy));
-        for (float a = 0; a < 1; a+=step)
-            DrawParticles(a*newx+(1-a)*oldx,a*newy+(1-a)*oldy,penSize,CurrentParticleType);
-    }
+    fprintf(timingsFile, "%lld,%d,%lld", frameTimes.GetFrames() - 1, simTimes.ticks, simTimes.droppedTicks);
+    for(int i = 0; i < PHASE_COUNT; i++)
+        fprintf(timingsFile, ",%.3f", frameTimes.GetLast(i) * 1000.0);
+    fprintf(timingsFile, "\n");
 }
 
-// Updating a virtual pixel
-inline void UpdateVirtualPixel(int x, int y)
+// Seconds between two SDL_GetPerformanceCounter() readings
+static double CounterSeconds(Uint64 from, Uint64 to)
 {
-    ParticleType same = vs[x+(WIDTH*y)];
-    if(same != NOTHING)
-    {
-        if(IsStillborn(same))
-            StillbornParticleLogic(x,y,same);
-        else
-        if ( fastrand() >= FASTRAND_MAX / 13 && same % 2 == 0) MoveParticle(x,y,same); //THe rand condition makes the particles fall unevenly
-    }
-
+    return (double)(to - from) / (double)SDL_GetPerformanceFrequency();
 }
 
-// Updating the particle system (virtual screen) pixel by pixel
-inline void UpdateVirtualScreen()
+// Drawing a line with the current brush
+void DrawLine(int newx, int newy, int oldx, int oldy)
 {
-    for(int y =0; y< HEIGHT-DASHBOARD_HEIGHT; y++)
-    {
-        // Due to biasing when iterating through the scanline from left to right,
-        // we now chose our direction randomly per scanline.
-        if (fastrand() % 2 == 0)
-            for(int x = WIDTH-2; x--;) UpdateVirtualPixel(x,y);
-        else
-            for(int x = 1; x < WIDTH - 1; x++) UpdateVirtualPixel(x,y);
-    }
+    sim->PaintLine(newx+cameraX, newy+cameraY, oldx+cameraX, oldy+cameraY, penSize, CurrentParticleType);
 }
 
-//Cearing the particle system
-void Clear()
+// Placing the buttons, done once: the loose materials, the spouts and the
+// fixed materials in groups from left to right, then the eraser
+void LayoutButtons()
 {
-    for(int w = 0; w < WIDTH ; w++)
+    static const ParticleType types[BUTTON_COUNT] =
     {
-        for(int h = 0; h < HEIGHT; h++)
+        WATER, SAND, SALT, OIL, FIRE, ACID, DIRT,
+        WATERSPOUT, SANDSPOUT, SALTSPOUT, OILSPOUT,
+        WALL, TORCH, STOVE, PLANT, ICE, IRONWALL, VOID,
+        NOTHING
+    };
+
+    for(int i = 0; i < BUTTON_COUNT; i++)
+    {
+        int x, y;
+        if(i < 7)
+        {
+            x = BUTTON_SIZE*i;
+            y = UPPER_ROW_Y;
+        }
+        else if(i < 11)
+        {
+            x = 75 + BUTTON_SIZE*(i-7);
+            y = MIDDLE_ROW_Y;
+        }
+        else if(i < 18)
         {
-            vs[w+(WIDTH*h)] = NOTHING;
+            x = 120 + BUTTON_SIZE*(i-11);
+            y = LOWER_ROW_Y;
         }
+        else
+        {
+            x = 195;
+            y = LOWER_ROW_Y;
+        }
+
+        Button[i].rect = { x + 1, y, BUTTON_SIZE, BUTTON_SIZE };
+        Button[i].particleType = types[i];
     }
 }
 
-void InitButtons()
+// Initializing the screen
+// (Re)creating the textures in the scene format, the old ones are gone
+// after a device reset
+void CreateTextures()
 {
-    // Update dashboard
-    SDL_Rect dashboard ;
-    dashboard.x = 0;
-    dashboard.y = HEIGHT-DASHBOARD_HEIGHT;
-    dashboard.w = WIDTH;
-    dashboard.h = DASHBOARD_HEIGHT;
-    SDL_SetRenderDrawColor( renderer, 155, 155, 155, 255 );
-
-    SDL_RenderFillRect( renderer, &dashboard );
-    // ?? SDL_RenderPresent(_renderer);
-    //SDL_UpdateRect ( screen , dashboard.x , dashboard.y , dashboard.w , dashboard.h ) ;
-
-    //set up water emit button
-    SDL_Rect wateroutput ;
-    wateroutput.x = 1;
-    wateroutput.y = UPPER_ROW_Y;
-    wateroutput.w = BUTTON_SIZE;
-    wateroutput.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[WATER].r, colors[WATER].g, colors[WATER].b, colors[WATER].a );
-    SDL_RenderFillRect( renderer, &wateroutput );
-
-    ButtonRect warect;
-    warect.rect = wateroutput;
-    warect.particleType = WATER;
-    Button[0] = warect;
-
-
-    //set up sand sand button
-    SDL_Rect sandoutput ;
-    sandoutput.x = BUTTON_SIZE + 1;
-    sandoutput.y = UPPER_ROW_Y;
-    sandoutput.w = BUTTON_SIZE;
-    sandoutput.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[SAND].r, colors[SAND].g, colors[SAND].b, colors[SAND].a );
-    SDL_RenderFillRect( renderer, &sandoutput );
-
-    ButtonRect sanrect;
-    sanrect.rect = sandoutput;
-    sanrect.particleType = SAND;
-    Button[1] = sanrect;
-
-    //set up salt emit button
-    SDL_Rect saltoutput ;
-    saltoutput.x = BUTTON_SIZE*2 + 1;
-    saltoutput.y = UPPER_ROW_Y;
-    saltoutput.w = BUTTON_SIZE;
-    saltoutput.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[SALT].r, colors[SALT].g, colors[SALT].b, colors[SALT].a );
-    SDL_RenderFillRect( renderer, &saltoutput );
-
-    ButtonRect sarect;
-    sarect.rect = saltoutput;
-    sarect.particleType = SALT;
-    Button[2] = sarect;
-
-    //set up oil button
-    SDL_Rect oiloutput ;
-    oiloutput.x = BUTTON_SIZE*3 + 1;
-    oiloutput.y = UPPER_ROW_Y;
-    oiloutput.w = BUTTON_SIZE;
-    oiloutput.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[OIL].r, colors[OIL].g, colors[OIL].b, colors[OIL].a );
-    SDL_RenderFillRect( renderer, &oiloutput );
-
-    ButtonRect oirect;
-    oirect.rect = oiloutput;
-    oirect.particleType = OIL;
-    Button[3] = oirect;
-
-    //set up fire button
-    SDL_Rect fire ;
-    fire.x = BUTTON_SIZE*4 + 1;
-    fire.y = UPPER_ROW_Y;
-    fire.w = BUTTON_SIZE;
-    fire.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[FIRE].r, colors[FIRE].g, colors[FIRE].b, colors[FIRE].a );
-    SDL_RenderFillRect( renderer, &fire );
-
-    ButtonRect firect;
-    firect.particleType = FIRE;
-    firect.rect = fire;
-    Button[4] = firect;
-
-    //set up acid button
-    SDL_Rect acid ;
-    acid.x = BUTTON_SIZE*5 + 1;
-    acid.y = UPPER_ROW_Y;
-    acid.w = BUTTON_SIZE;
-    acid.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[ACID].r, colors[ACID].g, colors[ACID].b, colors[ACID].a );
-    SDL_RenderFillRect( renderer, &acid );
-
-    ButtonRect acrect;
-    acrect.particleType = ACID;
-    acrect.rect = acid;
-    Button[5] = acrect;
-
-    //set up dirt emit button
-    SDL_Rect dirtoutput ;
-    dirtoutput.x = BUTTON_SIZE*6 + 1;
-    dirtoutput.y = UPPER_ROW_Y;
-    dirtoutput.w = BUTTON_SIZE;
-    dirtoutput.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[DIRT].r, colors[DIRT].g, colors[DIRT].b, colors[DIRT].a );
-    SDL_RenderFillRect( renderer, &dirtoutput );
-
-    ButtonRect direct;
-    direct.rect = dirtoutput;
-    direct.particleType = DIRT;
-    Button[6] = direct;
-
-    //set up spout water
-    SDL_Rect spwater ;
-    spwater.x = 75 + 1;
-    spwater.y = MIDDLE_ROW_Y;
-    spwater.w = BUTTON_SIZE;
-    spwater.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[WATERSPOUT].r, colors[WATERSPOUT].g, colors[WATERSPOUT].b, colors[WATERSPOUT].a );
-    SDL_RenderFillRect( renderer, &spwater );
-
-    ButtonRect spwrect;
-    spwrect.particleType = WATERSPOUT;
-    spwrect.rect = spwater;
-    Button[7] = spwrect;
-
-    //set up spout sand
-    SDL_Rect spdirt ;
-    spdirt.x = 75 + BUTTON_SIZE + 1;
-    spdirt.y = MIDDLE_ROW_Y;
-    spdirt.w = BUTTON_SIZE;
-    spdirt.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[SANDSPOUT].r, colors[SANDSPOUT].g, colors[SANDSPOUT].b, colors[SANDSPOUT].a );
-    SDL_RenderFillRect( renderer, &spdirt );
-
-    ButtonRect spdrect;
-    spdrect.particleType = SANDSPOUT;
-    spdrect.rect = spdirt;
-    Button[8] = spdrect;
-
-    //set up spout salt
-    SDL_Rect spsalt ;
-    spsalt.x = 75 + BUTTON_SIZE*2 + 1;
-    spsalt.y = MIDDLE_ROW_Y;
-    spsalt.w = BUTTON_SIZE;
-    spsalt.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[SALTSPOUT].r, colors[SALTSPOUT].g, colors[SALTSPOUT].b, colors[SALTSPOUT].a );
-    SDL_RenderFillRect( renderer, &spsalt );
-
-    ButtonRect spsrect;
-    spsrect.particleType = SALTSPOUT;
-    spsrect.rect = spsalt;
-    Button[9] = spsrect;
-
-    //set up spout oil
-    SDL_Rect spoil ;
-    spoil.x = 75 + BUTTON_SIZE*3 + 1;
-    spoil.y = MIDDLE_ROW_Y;
-    spoil.w = BUTTON_SIZE;
-    spoil.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[OILSPOUT].r, colors[OILSPOUT].g, colors[OILSPOUT].b, colors[OILSPOUT].a );
-    SDL_RenderFillRect( renderer, &spoil );
-
-    ButtonRect sporect;
-    sporect.particleType = OILSPOUT;
-    sporect.rect = spoil;
-    Button[10] = sporect;
-
-    //set up wall button
-    SDL_Rect wall ;
-    wall.x = 120 + 1;
-    wall.y = LOWER_ROW_Y;
-    wall.w = BUTTON_SIZE;
-    wall.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[WALL].r, colors[WALL].g, colors[WALL].b, colors[WALL].a );
-    SDL_RenderFillRect( renderer, &wall );
-
-    ButtonRect walrect;
-    walrect.particleType = WALL;
-    walrect.rect = wall;
-    Button[11] = walrect;
-
-    //set up torch button
-    SDL_Rect torch ;
-    torch.x = 120 + BUTTON_SIZE + 1;
-    torch.y = LOWER_ROW_Y;
-    torch.w = BUTTON_SIZE;
-    torch.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[TORCH].r, colors[TORCH].g, colors[TORCH].b, colors[TORCH].a );
-    SDL_RenderFillRect( renderer, &torch );
-
-    ButtonRect torect;
-    torect.particleType = TORCH;
-    torect.rect = torch;
-    Button[12] = torect;
-
-    //set up stove button
-    SDL_Rect stove ;
-    stove.x = 120 + BUTTON_SIZE*2 + 1;
-    stove.y = LOWER_ROW_Y;
-    stove.w = BUTTON_SIZE;
-    stove.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[STOVE].r, colors[STOVE].g, colors[STOVE].b, colors[STOVE].a );
-    SDL_RenderFillRect( renderer, &stove );
-
-    ButtonRect storect;
-    storect.particleType = STOVE;
-    storect.rect = stove;
-    Button[13] = storect;
-
-    //set up plant button
-    SDL_Rect plant ;
-    plant.x = 120 + BUTTON_SIZE*3 + 1;
-    plant.y = LOWER_ROW_Y;
-    plant.w = BUTTON_SIZE;
-    plant.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[PLANT].r, colors[PLANT].g, colors[PLANT].b, colors[PLANT].a );
-    SDL_RenderFillRect( renderer, &plant );
-
-    ButtonRect prect;
-    prect.particleType = PLANT;
-    prect.rect = plant;
-    Button[14] = prect;
-
-    //ICE
-    SDL_Rect ice ;
-    ice.x = 120 + BUTTON_SIZE*4 + 1;
-    ice.y = LOWER_ROW_Y;
-    ice.w = BUTTON_SIZE;
-    ice.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[ICE].r, colors[ICE].g, colors[ICE].b, colors[ICE].a );
-    SDL_RenderFillRect( renderer, &ice );
-
-    ButtonRect irect;
-    irect.particleType = ICE;
-    irect.rect = ice;
-    Button[15] = irect;
-
-    //IRONWALL
-    SDL_Rect iw ;
-    iw.x = 120 + BUTTON_SIZE*5 + 1;
-    iw.y = LOWER_ROW_Y;
-    iw.w = BUTTON_SIZE;
-    iw.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[IRONWALL].r, colors[IRONWALL].g, colors[IRONWALL].b, colors[IRONWALL].a );
-    SDL_RenderFillRect( renderer, &iw );
-
-    ButtonRect iwrect;
-    iwrect.particleType = IRONWALL;
-    iwrect.rect = iw;
-    Button[16] = iwrect;
-
-    //VOID
-    SDL_Rect voidele ;
-    voidele.x = 120 + BUTTON_SIZE*6 + 1;
-    voidele.y = LOWER_ROW_Y;
-    voidele.w = BUTTON_SIZE;
-    voidele.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, colors[VOID].r, colors[VOID].g, colors[VOID].b, colors[VOID].a );
-    SDL_RenderFillRect( renderer, &voidele );
-
-    ButtonRect voidelerect;
-    voidelerect.particleType = VOID;
-    voidelerect.rect = voidele;
-    Button[17] = voidelerect;
-
-    //eraser
-    SDL_Rect eraser ;
-    eraser.x = 195 + 1;
-    eraser.y = LOWER_ROW_Y;
-    eraser.w = BUTTON_SIZE;
-    eraser.h = BUTTON_SIZE;
-
-    SDL_SetRenderDrawColor( renderer, 0, 0, 0, 0 );
-    SDL_RenderFillRect( renderer, &eraser );
-
-    ButtonRect eraserrect;
-    eraserrect.particleType = NOTHING;
-    eraserrect.rect = eraser;
-    Button[18] = eraserrect;
+    if(scene_texture)
+        SDL_DestroyTexture(scene_texture);
+    if(dashboard_texture)
+        SDL_DestroyTexture(dashboard_texture);
+
+    scene_texture = SDL_CreateTexture(renderer, scene_format->format, SDL_TEXTUREACCESS_STREAMING, scene.w, scene.h);
+
+    // The dashboard is kept in a texture of its own when the renderer can
+    // draw into one
+    dashboard_texture = nullptr;
+    if (SDL_RenderTargetSupported(renderer))
+    {
+        dashboard_texture = SDL_CreateTexture(renderer, scene_format->format, SDL_TEXTUREACCESS_TARGET, dashboard.w, dashboard.h);
+        if (dashboard_texture)
+            SDL_SetTextureBlendMode(dashboard_texture, SDL_BLENDMODE_NONE);
+    }
+    screenReset = true;
+    dashboardDirty = true;
 }
 
-// Initializing the screen
 void init()
 {
     SDL_setenv("VITA_DISABLE_TOUCH_BACK", "1", 1);
@@ -1315,11 +546,44 @@ void init()
         fprintf(stderr, "Unable to create window: %s\n", SDL_GetError());
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    SDL_RenderSetLogicalSize(renderer, WIDTH, HEIGHT);
-    screen_buffer = (uint32_t *)calloc(WIDTH * HEIGHT, sizeof(uint32_t));
-    if (!screen_buffer) {
-        fprintf(stderr, "Failed to allocate screen buffer");
+    // Without a GPU, SDL either has no renderer to offer or its software
+    // one, which does the same work as drawing into the window surface, only
+    // slower
+    if (!softwareScreen)
+    {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        SDL_RendererInfo rendererInfo;
+        if (renderer && SDL_GetRendererInfo(renderer, &rendererInfo) == 0 && (rendererInfo.flags & SDL_RENDERER_SOFTWARE))
+        {
+            SDL_DestroyRenderer(renderer);
+            renderer = nullptr;
+        }
+        softwareScreen = renderer == nullptr;
+    }
+
+    if (softwareScreen)
+    {
+        surfaceScreen = new SurfaceScreen(window, WIDTH, HEIGHT);
+        if (!surfaceScreen->IsValid())
+        {
+            // Any renderer will do then, SDL's software one included
+            fprintf(stderr, "Unable to draw into the window: %s\n", SDL_GetError());
+            delete surfaceScreen;
+            surfaceScreen = nullptr;
+            softwareScreen = false;
+            renderer = SDL_CreateRenderer(window, -1, 0);
+        }
+    }
+
+    if (!surfaceScreen)
+    {
+        if (renderer == nullptr)
+        {
+            fprintf(stderr, "Unable to create a renderer: %s\n", SDL_GetError());
+            SDL_Quit();
+            exit(-1);
+        }
+        SDL_RenderSetLogicalSize(renderer, WIDTH, HEIGHT);
     }
 
     initColors();
@@ -1329,9 +593,35 @@ void init()
     scene.w = WIDTH;
     scene.h = HEIGHT-DASHBOARD_HEIGHT;
 
-    scene_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, scene.w, scene.h);
+    dashboard.x = 0;
+    dashboard.y = HEIGHT-DASHBOARD_HEIGHT;
+    dashboard.w = WIDTH;
+    dashboard.h = DASHBOARD_HEIGHT;
+    LayoutButtons();
 
-    InitButtons();
+    if (surfaceScreen)
+    {
+        InitPalette(surfaceScreen->GetFormat());
+        return;
+    }
+
+    // The first 32 bit format the renderer supports is the one it handles
+    // best; anything else gets converted on every upload
+    Uint32 format = SDL_PIXELFORMAT_ARGB8888;
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0)
+    {
+        for (Uint32 i = 0; i < info.num_texture_formats; i++)
+        {
+            if (!SDL_ISPIXELFORMAT_FOURCC(info.texture_formats[i]) && SDL_BYTESPERPIXEL(info.texture_formats[i]) == 4)
+            {
+                format = info.texture_formats[i];
+                break;
+            }
+        }
+    }
+    InitPalette(format);
+    CreateTextures();
 
     SDL_RenderPresent(renderer);
 }
@@ -1347,33 +637,47 @@ inline void CheckGuiInteraction()
     }
 }
 
-void drawSelection()
+// Drawing a frame around every button, pink for the selected one. The
+// dashboard drawing functions take the screen y of the render target's top
+// row, so they can draw into dashboard_texture as well as to the screen.
+void drawSelection(int originY)
 {
     for(int i = BUTTON_COUNT; i--;)
     {
         ButtonRect r = Button[i];
+        r.rect.y -= originY;
 
-        SDL_Rect top = {r.rect.x, r.rect.y, r.rect.w + 1, 1};
-        SDL_Rect bottom = {r.rect.x, r.rect.y + r.rect.h, r.rect.w + 1, 1};
-        SDL_Rect left = {r.rect.x, r.rect.y, 1, r.rect.h + 1};
-        SDL_Rect right = {r.rect.x + r.rect.w, r.rect.y, 1, r.rect.h + 1};
+        SDL_Rect edges[4] =
+        {
+            {r.rect.x, r.rect.y, r.rect.w + 1, 1},
+            {r.rect.x, r.rect.y + r.rect.h, r.rect.w + 1, 1},
+            {r.rect.x, r.rect.y, 1, r.rect.h + 1},
+            {r.rect.x + r.rect.w, r.rect.y, 1, r.rect.h + 1}
+        };
 
         if (CurrentParticleType == r.particleType)
-        {
-            SDL_SetRenderDrawColor( renderer, 255, 0, 255, 255 );
-            SDL_RenderFillRect( renderer, &top );
-            SDL_RenderFillRect( renderer, &bottom );
-            SDL_RenderFillRect( renderer, &left );
-            SDL_RenderFillRect( renderer, &right );
-        }
+            SetDrawColor( 255, 0, 255, 255 );
         else
-        {
-            SDL_SetRenderDrawColor( renderer, 0, 0, 0, 255 );
-            SDL_RenderFillRect( renderer, &top );
-            SDL_RenderFillRect( renderer, &bottom );
-            SDL_RenderFillRect( renderer, &left );
-            SDL_RenderFillRect( renderer, &right );
-        }
+            SetDrawColor( 0, 0, 0, 255 );
+        FillRects( edges, 4 );
+    }
+}
+
+// Drawing the dashboard background and the buttons in their colors
+void drawButtons(int originY)
+{
+    SDL_Rect background = { dashboard.x, dashboard.y - originY, dashboard.w, dashboard.h };
+    SetDrawColor( 155, 155, 155, 255 );
+    FillRect( background );
+
+    for(int i = 0; i < BUTTON_COUNT; i++)
+    {
+        SDL_Rect r = Button[i].rect;
+        r.y -= originY;
+
+        const SDL_Color &color = colors[Button[i].particleType];
+        SetDrawColor( color.r, color.g, color.b, color.a );
+        FillRect( r );
     }
 }
 
@@ -1382,14 +686,17 @@ void drawCursor(int x, int y)
     SDL_Rect partHorizontal = { x+1, y+1, 4, 1 };
     SDL_Rect partVertical = { x+1, y+1, 1, 4 };
 
-    SDL_SetRenderDrawColor( renderer, 255, 0, 255, 255 );
-    SDL_RenderFillRect( renderer, &partHorizontal );
-    SDL_RenderFillRect( renderer, &partVertical );
+    SetDrawColor( 255, 0, 255, 255 );
+    FillRect( partHorizontal );
+    FillRect( partVertical );
+
+    SDL_Rect covered = { x+1, y+1, 4, 4 };
+    Overlay(covered);
 }
 
-void drawPenSize()
+void drawPenSize(int originY)
 {
-    SDL_Rect size = { WIDTH - BUTTON_SIZE, HEIGHT - BUTTON_SIZE - 1, 0, 0 };
+    SDL_Rect size = { WIDTH - BUTTON_SIZE, HEIGHT - BUTTON_SIZE - 1 - originY, 0, 0 };
 
     switch(penSize)
     {
@@ -1422,8 +729,45 @@ void drawPenSize()
             break;
     }
 
-    SDL_SetRenderDrawColor( renderer, 0, 0, 0, 255 );
-    SDL_RenderFillRect( renderer, &size );
+    SetDrawColor( 0, 0, 0, 255 );
+    FillRect( size );
+}
+
+// Drawing the dashboard. It only changes with the selection and the pen
+// size, so it is drawn into dashboard_texture when one of them changed and
+// copied to the screen in one go. The window surface keeps it as it is, and
+// it is only drawn again there when it changed or the cursor was over it.
+// Renderers without render targets get it drawn every frame.
+void drawDashboard()
+{
+    bool changed = dashboardDirty || dashboardType != CurrentParticleType || dashboardPenSize != penSize;
+    if(surfaceScreen)
+    {
+        for(const SDL_Rect &over : lastOverlaid)
+            changed = changed || SDL_HasIntersection(&over, &dashboard);
+    }
+
+    if(dashboard_texture && changed)
+    {
+        SDL_SetRenderTarget(renderer, dashboard_texture);
+        drawButtons(dashboard.y);
+        drawSelection(dashboard.y);
+        drawPenSize(dashboard.y);
+        SDL_SetRenderTarget(renderer, nullptr);
+    }
+    else if(!dashboard_texture && (changed || !surfaceScreen))
+    {
+        drawButtons(0);
+        drawSelection(0);
+        drawPenSize(0);
+    }
+
+    dashboardDirty = false;
+    dashboardType = CurrentParticleType;
+    dashboardPenSize = penSize;
+
+    if(dashboard_texture)
+        SDL_RenderCopy(renderer, dashboard_texture, nullptr, &dashboard);
 }
 
 
@@ -1436,9 +780,9 @@ int main(int argc, char **argv)
     CCmdLine cmdLine;
 
     // parse the command line.
-    if (cmdLine.SplitLine(argc, argv) < 1)
+    if (cmdLine.SplitLine(argc, argv) < 1 || (!cmdLine.HasSwitch("-height") && !cmdLine.HasSwitch("-width")))
     {
-        // no switches were given on the command line
+        // no size was given on the command line
         //Set default size
         HEIGHT = 170;
         WIDTH = 300;
@@ -1472,11 +816,45 @@ int main(int argc, char **argv)
     MIDDLE_ROW_Y = HEIGHT - BUTTON_SIZE - 1;
     LOWER_ROW_Y = HEIGHT - BUTTON_SIZE - 1;
 
-    vs = new ParticleType[HEIGHT*WIDTH];
+    // The world can be larger than the screen, the camera then scrolls over it
+    worldWidth = WIDTH;
+    worldHeight = HEIGHT-DASHBOARD_HEIGHT;
+    if (cmdLine.HasSwitch("-worldwidth"))
+        worldWidth = atoi(cmdLine.GetSafeArgument("-worldwidth", 0, "0").c_str());
+    if (cmdLine.HasSwitch("-worldheight"))
+        worldHeight = atoi(cmdLine.GetSafeArgument("-worldheight", 0, "0").c_str());
+    if (worldWidth < WIDTH)
+        worldWidth = WIDTH;
+    if (worldHeight < HEIGHT-DASHBOARD_HEIGHT)
+        worldHeight = HEIGHT-DASHBOARD_HEIGHT;
+    cameraX = (worldWidth - WIDTH) / 2;
+
+    world = new World(worldWidth, worldHeight);
+
+    // Number of simulation threads, 0 = one per core
+    world->SetThreads(atoi(cmdLine.GetSafeArgument("-threads", 0, "1").c_str()));
+
+    // Random numbers from a hash of (seed, step, x, y) instead of a generator per band
+    if (cmdLine.HasSwitch("-counterrand"))
+        world->SetRandomMode(RANDOM_COUNTER);
+
+    // Materials and reactions, if not the built-in ones
+    if (cmdLine.HasSwitch("-materials"))
+    {
+        Materials materials;
+        std::string error;
+        if (!materials.Load(cmdLine.GetSafeArgument("-materials", 0, "materials.txt"), error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            exit(-1);
+        }
+        world->SetMaterials(materials);
+    }
 
+    // Drawing into the window surface instead of through a renderer
+    softwareScreen = cmdLine.HasSwitch("-software");
 
     init();
-    Clear();
 
     int done=0;
 
@@ -1493,38 +871,103 @@ int main(int argc, char **argv)
     float oilDens = 0.3f;
 
     // Set initial seed
-    fast_srand( (unsigned)time( nullptr ) );
+    if (cmdLine.HasSwitch("-seed"))
+        world->Seed(strtoul(cmdLine.GetSafeArgument("-seed", 0, "1").c_str(), nullptr, 10));
+    else
+        world->Seed( (unsigned)time( nullptr ) );
+
+    // Record the input of the session for sandreplay
+    if (cmdLine.HasSwitch("-record"))
+    {
+        std::string error;
+        if (!recorder.Open(cmdLine.GetSafeArgument("-record", 0, "session.rec"), *world, error))
+            fprintf(stderr, "%s\n", error.c_str());
+    }
 
     int oldx = WIDTH/2, oldy = HEIGHT/2;
 
     //Mouse button pressed down?
     bool down = false;
 
-    //Used for calculating the average FPS from NumFrames
-    const int NumFrames = 20;
-    int AvgFrameTimes[NumFrames];
-    for(int & AvgFrameTime : AvgFrameTimes)
-        AvgFrameTime = 0;
-    int FrameTime = 0;
-    int PrevFrameTime = 0;
-    int Index = 0;
+    //Where the time of every frame goes
+    if (cmdLine.HasSwitch("-timings"))
+    {
+        std::string path = cmdLine.GetSafeArgument("-timings", 0, "timings.csv");
+        if (!OpenTimings(path.c_str()))
+            fprintf(stderr, "Unable to write %s\n", path.c_str());
+    }
 
     int slow = false;
 
-    //The frames per second cap timer
-    LTimer capTimer;
+    //The simulation runs at a fixed rate, however long a frame takes to draw
+    double tickRate = atof(cmdLine.GetSafeArgument("-tickrate", 0, "30").c_str());
+    if(tickRate <= 0)
+        tickRate = DEFAULT_TICK_RATE;
+    sim = new SimThread(*world, scene.w, scene.h, tickRate, MAX_TICKS_PER_FRAME, recorder.IsOpen() ? &recorder : nullptr);
+    uint64_t lastTicks = 0;
+
+    //Last input handed to the simulation. The first frame already shows
+    //what the camera looks at.
+    SimInput input;
+    memset(&input, 0, sizeof(input));
+    input.viewX = cameraX;
+    input.viewY = cameraY;
+    sim->SetInput(input);
+    sim->Start();
+
+    //A timeline of every frame and thread, for chrome://tracing or Perfetto
+    if (cmdLine.HasSwitch("-trace"))
+    {
+        std::string error;
+        if (Trace::Start(cmdLine.GetSafeArgument("-trace", 0, "trace.json"), error))
+            Trace::SetThreadName("main");
+        else
+            fprintf(stderr, "%s\n", error.c_str());
+    }
+
+    //Adds the time since the last call to a phase of the frame (and a zone
+    //to the trace)
+    Uint64 lap = SDL_GetPerformanceCounter();
+    int64_t traceLap = Trace::Now();
+    auto Lap = [&lap, &traceLap](FramePhase phase)
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        frameTimes.Add(phase, CounterSeconds(lap, now));
+        lap = now;
+
+        int64_t traceNow = Trace::Now();
+        Trace::Add(PHASE_NAMES[phase], traceLap, traceNow);
+        traceLap = traceNow;
+    };
 
     //The game loop
     while(done == 0)
     {
-        //Start cap timer
-        capTimer.start();
+        lap = SDL_GetPerformanceCounter();
+        traceLap = Trace::Now();
 
         SDL_Event event;
         //Polling events
         while ( SDL_PollEvent(&event) )
         {
             if ( event.type == SDL_QUIT )  {  done = 1;  }
+            //Some renderers lose what was drawn into textures
+            if ( event.type == SDL_RENDER_TARGETS_RESET )  {  screenReset = true;  dashboardDirty = true;  }
+            //Others lose the textures themselves
+            if ( event.type == SDL_RENDER_DEVICE_RESET )  {  CreateTextures();  }
+            //The window surface goes with the old window size
+            if ( surfaceScreen && event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED )
+            {
+                surfaceScreen->Reset();
+                InitPalette(surfaceScreen->GetFormat());
+                screenReset = true;
+                dashboardDirty = true;
+            }
+            //The renderer scales the mouse to the screen on its own
+            if ( surfaceScreen && (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP) )
+                surfaceScreen->ToLogical(event.button.x, event.button.y);
+            if ( surfaceScreen && event.type == SDL_MOUSEMOTION )
+                surfaceScreen->ToLogical(event.motion.x, event.motion.y);
             //Key strokes
             if ( event.type == SDL_CONTROLLERBUTTONDOWN )
             {
@@ -1532,7 +975,7 @@ int main(int argc, char **argv)
                 {
                     case SDL_CONTROLLER_BUTTON_START:
                     case SDL_CONTROLLER_BUTTON_BACK:
-                        Clear();
+                        sim->Clear();
                         break;
                     case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
                         for(int i = BUTTON_COUNT; i--;)
@@ -1592,6 +1035,12 @@ int main(int argc, char **argv)
                     case SDL_CONTROLLER_BUTTON_Y:
                         slow ^= true;
                         break;
+                    case SDL_CONTROLLER_BUTTON_LEFTSTICK:
+                        showCensus ^= true;
+                        break;
+                    case SDL_CONTROLLER_BUTTON_RIGHTSTICK:
+                        showTimings ^= true;
+                        break;
                     case SDL_CONTROLLER_BUTTON_X:
                         emitOil ^= true;
                         emitSalt ^= true;
@@ -1696,6 +1145,49 @@ int main(int argc, char **argv)
                             canMoveY = 1;
                         }
                         break;
+                    case 2:		// axis 2 (right stick left-right), scrolls
+                        if(event.jaxis.value < -JOY_DEADZONE || event.jaxis.value > JOY_DEADZONE)
+                            cameraSpeedX = 16 * event.jaxis.value / 32768;
+                        else
+                            cameraSpeedX = 0;
+                        break;
+                    case 3:		// axis 3 (right stick up-down), scrolls
+                        if(event.jaxis.value < -JOY_DEADZONE || event.jaxis.value > JOY_DEADZONE)
+                            cameraSpeedY = 16 * event.jaxis.value / 32768;
+                        else
+                            cameraSpeedY = 0;
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+            // Arrow keys scroll while held
+            if(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+            {
+                int speed = event.type == SDL_KEYDOWN ? 8 : 0;
+                switch(event.key.keysym.sym)
+                {
+                    case SDLK_LEFT:
+                        cameraSpeedX = -speed;
+                        break;
+                    case SDLK_RIGHT:
+                        cameraSpeedX = speed;
+                        break;
+                    case SDLK_UP:
+                        cameraSpeedY = -speed;
+                        break;
+                    case SDLK_DOWN:
+                        cameraSpeedY = speed;
+                        break;
+                    case SDLK_F1:
+                        if(event.type == SDL_KEYDOWN && !event.key.repeat)
+                            showCensus ^= true;
+                        break;
+                    case SDLK_F2:
+                        if(event.type == SDL_KEYDOWN && !event.key.repeat)
+                            showTimings ^= true;
+                        break;
 
                     default:
                         break;
@@ -1735,77 +1227,146 @@ int main(int argc, char **argv)
                 CheckGuiInteraction();
         }
 
-        if(slow)
-        {
-            if(speedX > 0)
-                oldx += 1;
-            else if(speedX < 0)
-                oldx += -1;
-            if(speedY > 0)
-                oldy += 1;
-            else if(speedY < 0)
-                oldy += -1;
-        }
-        else
+        Lap(PHASE_EVENTS);
+
+        //The cursor and the camera move with the simulation, a step per tick
+        uint64_t ticks = sim->GetTicks();
+        for(; lastTicks < ticks; lastTicks++)
         {
-            oldx += speedX;
-            oldy += speedY;
+            cameraX += cameraSpeedX;
+            cameraY += cameraSpeedY;
+            if(cameraX > worldWidth - scene.w)
+                cameraX = worldWidth - scene.w;
+            if(cameraX < 0)
+                cameraX = 0;
+            if(cameraY > worldHeight - scene.h)
+                cameraY = worldHeight - scene.h;
+            if(cameraY < 0)
+                cameraY = 0;
+
+            if(slow)
+            {
+                if(speedX > 0)
+                    oldx += 1;
+                else if(speedX < 0)
+                    oldx += -1;
+                if(speedY > 0)
+                    oldy += 1;
+                else if(speedY < 0)
+                    oldy += -1;
+            }
+            else
+            {
+                oldx += speedX;
+                oldy += speedY;
+            }
+
+            if(oldx < 0)
+                oldx = 0;
+            else if(oldx > WIDTH)
+                oldx = WIDTH;
+
+            if(oldy < 0)
+                oldy = 0;
+            else if(oldy > HEIGHT)
+                oldy = HEIGHT;
         }
 
-        if(oldx < 0)
-            oldx = 0;
-        else if(oldx > WIDTH)
-            oldx = WIDTH;
-
-        if(oldy < 0)
-            oldy = 0;
-        else if(oldy > HEIGHT)
-            oldy = HEIGHT;
-
-        //To emit or not to emit
-        if(emitWater)
-            Emit((WIDTH/2 - ((WIDTH/6)*2)), 20, WATER, waterDens);
-        if(emitSand)
-            Emit((WIDTH/2 - (WIDTH/6)), 20, SAND, sandDens);
-        if(emitSalt)
-            Emit((WIDTH/2 + (WIDTH/6)), 20, SALT, saltDens);
-        if(emitOil)
-            Emit((WIDTH/2 + ((WIDTH/6)*2)), 20, OIL, oilDens);
+        //To emit or not to emit. Set field by field, the padding has to
+        //stay zeroed for the memcmp below.
+        SimInput next;
+        memset(&next, 0, sizeof(next));
+        int emitterLeft = (worldWidth - WIDTH) / 2;
+        auto SetEmitter = [&next](int i, int x, ParticleType type, float density, bool on)
+        {
+            next.emitters[i].x = x;
+            next.emitters[i].width = 20;
+            next.emitters[i].type = type;
+            next.emitters[i].density = density;
+            next.emitters[i].on = on;
+        };
+        SetEmitter(0, emitterLeft + (WIDTH/2 - ((WIDTH/6)*2)), WATER, waterDens, emitWater);
+        SetEmitter(1, emitterLeft + (WIDTH/2 - (WIDTH/6)), SAND, sandDens, emitSand);
+        SetEmitter(2, emitterLeft + (WIDTH/2 + (WIDTH/6)), SALT, saltDens, emitSalt);
+        SetEmitter(3, emitterLeft + (WIDTH/2 + ((WIDTH/6)*2)), OIL, oilDens, emitOil);
 
         //If the button is pressed (and no event has occured since last frame due
         // to the polling procedure, then draw at the position (enabeling 'dynamic emitters')
-        if(down)
-            DrawLine(oldx,oldy,oldx,oldy);
+        next.brushDown = down;
+        next.brushX = oldx + cameraX;
+        next.brushY = oldy + cameraY;
+        next.brushRadius = penSize;
+        next.brushType = CurrentParticleType;
+        next.viewX = cameraX;
+        next.viewY = cameraY;
+
+        if(memcmp(&next, &input, sizeof(input)) != 0)
+        {
+            input = next;
+            sim->SetInput(input);
+        }
 
-        //Clear bottom line
-        for (int i=0; i< WIDTH; i++) vs[i+((HEIGHT-DASHBOARD_HEIGHT-1)*WIDTH)] = NOTHING;
-        //Clear top line
-        for (int i=0; i< WIDTH; i++) vs[i+((0)*WIDTH)] = NOTHING;
+        Lap(PHASE_INPUT);
 
-        // Update the virtual screen (performing particle logic)
-        UpdateVirtualScreen();
+        //Nothing new to show yet. The time spent waiting belongs to no phase.
+        if(!sim->AcquireFrame())
+        {
+            SDL_Delay(1);
+            continue;
+        }
+
+        const SimTimes &simTimes = sim->GetTimes();
+        frameTimes.Add(PHASE_EMIT, simTimes.emitSeconds);
+        frameTimes.Add(PHASE_STEP, simTimes.stepSeconds);
 
-        SDL_SetRenderDrawColor(renderer, 0,0,0,255);
-        SDL_RenderClear(renderer);
+        static long long droppedTicks = 0;
+        if(simTimes.droppedTicks > droppedTicks)
+            behindFrames = PhaseTimes::WINDOW;
+        else if(behindFrames > 0)
+            behindFrames--;
+        droppedTicks = simTimes.droppedTicks;
+
+        if(!surfaceScreen)
+        {
+            SDL_SetRenderDrawColor(renderer, 0,0,0,255);
+            SDL_RenderClear(renderer);
+        }
         // Map the virtual screen to the real screen
         DrawScene();
-        InitButtons();
-        drawSelection();
-        drawPenSize();
+        Lap(PHASE_SCENE);
+
+        if(showCensus)
+            drawCensus();
+        if(showTimings)
+            drawTimings();
+        drawDashboard();
         drawCursor(oldx, oldy);
+        Lap(PHASE_DASHBOARD);
+
         //Fip the vs
-        SDL_RenderPresent(renderer);
+        if(surfaceScreen)
+            surfaceScreen->Present();
+        else
+            SDL_RenderPresent(renderer);
+        Lap(PHASE_PRESENT);
 
-        //If frame finished early
-        int frameTicks = capTimer.getTicks();
-        if( frameTicks < SCREEN_TICKS_PER_FRAME )
-        {
-            //Wait remaining time
-            SDL_Delay( SCREEN_TICKS_PER_FRAME - frameTicks );
-        }
+        frameTimes.EndFrame();
+        if(timingsFile)
+            WriteTimings(simTimes);
     }
 
     //Loop ended - quit SDL
+    sim->Stop();
+    delete sim;
+#ifdef SAND_PROFILE
+    world->GetProfile().Print(stderr, world->GetMaterials());
+#endif
+    recorder.Close();
+    if(timingsFile)
+        fclose(timingsFile);
+    Trace::Stop();
+    delete world;
+    delete surfaceScreen;
     SDL_Quit( );
     if(SDL_NumJoysticks() > 0)
         SDL_JoystickClose(nullptr);
@@ -0,0 +1,124 @@
+/*
+ *  SDL2Sand
+ *
+ *  Copyright © 2006 Thomas RenÈ Sidor, Kristian Jensen
+ *  Copyright © 2014 Artur Rojek
+ *  Copyright © 2022 Volodymyr Atamanenko
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+// Replays a session recorded with the game's -record switch as fast as the
+// CPU allows, printing the grid hash after every frame.
+//
+//   sandreplay -in session.rec [-threads 1] [-materials materials.txt] [-quiet]
+//              [-trace trace.json]
+//
+// With -quiet only the hash of the last frame is printed. -trace writes a
+// timeline of the frames, steps and bands for chrome://tracing or Perfetto.
+// A recording made with another material table than the one given is
+// refused, it would not play back the same.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "CmdLine.h"
+#include "Recording.h"
+#include "Trace.h"
+
+int main(int argc, char **argv)
+{
+    CCmdLine cmdLine;
+    cmdLine.SplitLine(argc, argv);
+
+    if (!cmdLine.HasSwitch("-in"))
+    {
+        fprintf(stderr, "Usage: sandreplay -in <recording> [-threads N] [-materials <file>] [-quiet] [-trace <file>]\n");
+        return 1;
+    }
+
+    Recording recording;
+    std::string error;
+    if (!recording.Load(cmdLine.GetSafeArgument("-in", 0, ""), error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    World world(recording.GetWidth(), recording.GetHeight());
+    world.SetThreads(atoi(cmdLine.GetSafeArgument("-threads", 0, "1").c_str()));
+    recording.Start(world);
+
+    if (cmdLine.HasSwitch("-materials"))
+    {
+        Materials materials;
+        if (!materials.Load(cmdLine.GetSafeArgument("-materials", 0, "materials.txt"), error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        world.SetMaterials(materials);
+    }
+
+    uint64_t materialsHash = world.GetMaterials().GetHash();
+    if (recording.HasMaterialsHash() && recording.GetMaterialsHash() != materialsHash)
+    {
+        fprintf(stderr, "The recording was made with another material table (%016llx, this one is %016llx), pass the -materials file the game ran with\n",
+                (unsigned long long)recording.GetMaterialsHash(), (unsigned long long)materialsHash);
+        return 1;
+    }
+
+    if (cmdLine.HasSwitch("-trace"))
+    {
+        if (!Trace::Start(cmdLine.GetSafeArgument("-trace", 0, "trace.json"), error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        Trace::SetThreadName("main");
+    }
+
+    bool quiet = cmdLine.HasSwitch("-quiet");
+    int frames = recording.GetFrames();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        TraceZone zone("frame", "frame", i);
+        recording.PlayFrame(world, i);
+        if (!quiet)
+            printf("frame %d %016llx\n", i, (unsigned long long)world.GetHash());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (quiet)
+        printf("frame %d %016llx\n", frames-1, (unsigned long long)world.GetHash());
+    fprintf(stderr, "%dx%d on %d thread(s), %d frames in %.3f s: %.1f frames/s\n",
+            recording.GetWidth(), recording.GetHeight(), world.GetThreads(), frames, seconds,
+            seconds > 0 ? frames / seconds : 0.0);
+
+#ifdef SAND_PROFILE
+    world.GetProfile().Print(stderr, world.GetMaterials());
+#endif
+
+    if (Trace::IsRunning() && !Trace::Stop())
+    {
+        fprintf(stderr, "Unable to write the trace\n");
+        return 1;
+    }
+    return 0;
+}